@@ -2,8 +2,25 @@
 #define CHEBTOOLS_H
 
 #include "Eigen/Dense"
+#include "Eigen/Sparse"
 #include <vector>
 #include <queue>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <array>
+#include <complex>
+
+/**
+ * The number of coefficients that are stored inline in a ChebyshevExpansion before falling back to the heap.
+ * Each inline coefficient adds 8 bytes to sizeof(ChebyshevExpansion) whatever the degree (about 200 bytes in all
+ * with the default of 17, against about 64 bytes with heap-only storage), in exchange for no heap allocation up to
+ * degree 16.  Define a smaller value for denser collections of low-degree expansions.
+ */
+#ifndef CHEBTOOLS_INLINE_COEFFICIENTS
+#define CHEBTOOLS_INLINE_COEFFICIENTS 17
+#endif
 
 namespace ChebTools{
 
@@ -50,13 +67,276 @@ namespace ChebTools{
     };
 
     typedef Eigen::VectorXd vectype;
+
+    /**
+    * @brief Storage for the coefficients of an expansion with a small inline buffer
+    *
+    * Up to CHEBTOOLS_INLINE_COEFFICIENTS coefficients (degree 16 by default) are held inside the
+    * object itself, so that building, copying and destroying low-degree expansions does not touch the
+    * heap.  Longer coefficient vectors are allocated on the heap.  The data are accessed through an
+    * Eigen::Map so that the numerical code is the same in both cases.
+    */
+    class CoefficientStorage {
+    private:
+        Eigen::Index m_size = 0;
+        double m_inline[CHEBTOOLS_INLINE_COEFFICIENTS];
+        std::unique_ptr<double[]> m_heap;
+        bool is_inline() const { return m_size <= CHEBTOOLS_INLINE_COEFFICIENTS; }
+    public:
+        static constexpr Eigen::Index inline_capacity = CHEBTOOLS_INLINE_COEFFICIENTS;
+
+        CoefficientStorage() = default;
+        CoefficientStorage(const CoefficientStorage& other) { assign(other.map()); }
+        CoefficientStorage(CoefficientStorage&& other) noexcept { *this = std::move(other); }
+        CoefficientStorage& operator=(const CoefficientStorage& other) {
+            if (this != &other) { assign(other.map()); }
+            return *this;
+        }
+        CoefficientStorage& operator=(CoefficientStorage&& other) noexcept {
+            if (this == &other) { return *this; }
+            if (other.is_inline()) {
+                m_heap.reset();
+                std::copy(other.m_inline, other.m_inline + other.m_size, m_inline);
+            }
+            else {
+                // Steal the heap buffer of the donor
+                m_heap = std::move(other.m_heap);
+            }
+            m_size = other.m_size;
+            other.m_size = 0;
+            return *this;
+        }
+
+        Eigen::Index size() const { return m_size; }
+        double* data() { return is_inline() ? m_inline : m_heap.get(); }
+        const double* data() const { return is_inline() ? m_inline : m_heap.get(); }
+        double& operator()(Eigen::Index i) { return data()[i]; }
+        double operator()(Eigen::Index i) const { return data()[i]; }
+        double& operator[](Eigen::Index i) { return data()[i]; }
+        double operator[](Eigen::Index i) const { return data()[i]; }
+
+        /// Mutable view of the coefficients as an Eigen vector
+        Eigen::Map<vectype> map() { return Eigen::Map<vectype>(data(), m_size); }
+        /// Const view of the coefficients as an Eigen vector
+        Eigen::Map<const vectype> map() const { return Eigen::Map<const vectype>(data(), m_size); }
+
+        /// Resize the storage; the values are left uninitialized
+        void resize(Eigen::Index N) {
+            if (N > CHEBTOOLS_INLINE_COEFFICIENTS && (is_inline() || N > m_size)) {
+                m_heap.reset(new double[N]);
+            }
+            else if (N <= CHEBTOOLS_INLINE_COEFFICIENTS) {
+                m_heap.reset();
+            }
+            m_size = N;
+        }
+        /// Resize the storage, keeping the first min(N, size()) values
+        void conservativeResize(Eigen::Index N) {
+            if (!is_inline() && N > CHEBTOOLS_INLINE_COEFFICIENTS && N <= m_size) {
+                // Shrinking within the heap buffer, nothing to move
+                m_size = N;
+                return;
+            }
+            CoefficientStorage old(std::move(*this));
+            resize(N);
+            Eigen::Index Ncopy = std::min(N, old.size());
+            std::copy(old.data(), old.data() + Ncopy, data());
+        }
+        /// Copy the values of an Eigen vector or array expression into the storage
+        template<typename Derived>
+        void assign(const Eigen::DenseBase<Derived>& c) {
+            resize(c.size());
+            map().noalias() = c.derived().matrix();
+        }
+    };
     
+    namespace detail {
+        /// \f$\cos(\pi\,{\rm num}/{\rm den})\f$, with exact integer reduction to [0, pi/4] and a long double series, usable at compile time
+        constexpr double cos_pi_ratio(long long num, long long den) {
+            num %= 2*den;
+            if (num < 0) { num += 2*den; }
+            if (num > den) { num = 2*den - num; } // cos(pi r) = cos(pi (2-r))
+            int sign = 1;
+            if (2*num > den) { num = den - num; sign = -1; } // cos(pi r) = -cos(pi (1-r))
+            const long double pi = 3.141592653589793238462643383279502884L;
+            // For r > 1/4, cos(pi r) = sin(pi (1/2 - r)); both arguments are then at most pi/4
+            const bool use_sin = 4*num > den;
+            const long double x = (use_sin) ? pi*static_cast<long double>(den - 2*num)/static_cast<long double>(2*den) : pi*static_cast<long double>(num)/static_cast<long double>(den);
+            long double term = (use_sin) ? x : 1.0L, sum = term;
+            for (int k = 1; k < 30; ++k) {
+                const int n = (use_sin) ? 2*k + 1 : 2*k;
+                term *= -x*x/static_cast<long double>((n - 1)*n);
+                sum += term;
+            }
+            return static_cast<double>(sign*sum);
+        }
+        /// The k-th Chebyshev-Lobatto node of degree N, \f$\cos(\pi k/N)\f$
+        constexpr double CL_node(long long k, long long N) { return cos_pi_ratio(k, N); }
+        /// Element (j,k) of the matrix U taking coefficients to values at the nodes of degree N
+        constexpr double U_entry(long long j, long long k, long long N) { return cos_pi_ratio(j*k, N); }
+        /// Element (j,k) of the matrix L taking values at the nodes of degree N to coefficients
+        constexpr double L_entry(long long j, long long k, long long N) {
+            const double p_j = (j == 0 || j == N) ? 2 : 1, p_k = (k == 0 || k == N) ? 2 : 1;
+            return 2.0/(p_j*p_k*static_cast<double>(N))*cos_pi_ratio(j*k, N);
+        }
+    }
+
+    /// The largest degree for which Chebyshev-Lobatto nodes and transform matrices are held in fixed tables
+    constexpr std::size_t max_fixed_degree = 64;
+
+    /**
+    * @brief The Chebyshev-Lobatto nodes and the L and U transform matrices of degree N, computed at compile time
+    *
+    * The tables are std::array (the matrices in column-major order), and fixed-size Eigen maps over them let the
+    * transforms of degree N be sized at compile time, with no lookup and no heap allocation.  The same values are
+    * used by get_CLnodes and the matrix libraries for degrees up to max_fixed_degree.
+    */
+    template<std::size_t N>
+    struct ChebyshevLobattoTables {
+        static_assert(N >= 1 && N <= max_fixed_degree, "Degree of fixed tables must be in [1, max_fixed_degree]");
+        using Vector = Eigen::Matrix<double, N + 1, 1>;
+        using Matrix = Eigen::Matrix<double, N + 1, N + 1>;
+    private:
+        static constexpr std::array<double, N + 1> make_nodes() {
+            std::array<double, N + 1> x{};
+            for (std::size_t k = 0; k <= N; ++k) { x[k] = detail::CL_node(k, N); }
+            return x;
+        }
+        template<bool is_L>
+        static constexpr std::array<double, (N + 1)*(N + 1)> make_matrix() {
+            std::array<double, (N + 1)*(N + 1)> A{};
+            for (std::size_t k = 0; k <= N; ++k) {
+                for (std::size_t j = 0; j <= N; ++j) {
+                    A[k*(N + 1) + j] = (is_L) ? detail::L_entry(j, k, N) : detail::U_entry(j, k, N);
+                }
+            }
+            return A;
+        }
+    public:
+        static constexpr std::array<double, N + 1> nodes = make_nodes(); ///< The nodes in [-1, 1], from 1 to -1
+        static constexpr std::array<double, (N + 1)*(N + 1)> L = make_matrix<true>(); ///< Values at the nodes to coefficients
+        static constexpr std::array<double, (N + 1)*(N + 1)> U = make_matrix<false>(); ///< Coefficients to values at the nodes
+        static Eigen::Map<const Vector> nodes_map() { return Eigen::Map<const Vector>(nodes.data()); }
+        static Eigen::Map<const Matrix> L_map() { return Eigen::Map<const Matrix>(L.data()); }
+        static Eigen::Map<const Matrix> U_map() { return Eigen::Map<const Matrix>(U.data()); }
+    };
+
     /// Get the Chebyshev-Lobatto nodes for an expansion of degree \f$N\f$
     const Eigen::VectorXd &get_CLnodes(std::size_t N);
 
+    /**
+    * @brief Build the Chebyshev-Lobatto nodes and the L and U matrices of the given degrees ahead of time
+    *
+    * The first use of each degree otherwise builds them, with a cosine for every element of the \f$(N+1)^2\f$
+    * matrices; warming up at startup takes that latency off the first fit or product.
+    */
+    void warmup(const std::vector<std::size_t> &degrees);
+
+    /// The degrees whose nodes or transform matrices are currently cached, in increasing order
+    std::vector<std::size_t> cached_degrees();
+
+    /**
+    * @brief Write the cached nodes and L and U matrices of every cached degree to a binary file
+    * @param path The path of the file
+    *
+    * The file holds raw doubles in native byte order, so it is only portable between machines of the same architecture.
+    */
+    void save_transform_cache(const std::string &path);
+
+    /**
+    * @brief Load the nodes and L and U matrices written by save_transform_cache into the caches
+    * @param path The path of the file
+    * @returns The number of degrees in the file
+    *
+    * Degrees that are already cached keep their current values, so references handed out before stay valid.
+    */
+    std::size_t load_transform_cache(const std::string &path);
+
     Eigen::VectorXcd eigenvalues(const Eigen::MatrixXd &A, bool balance);
+    /**
+    * @brief Balance a colleague matrix in place in its compact form, in O(N) operations per sweep
+    *
+    * The colleague matrix \f$\mathbf{A}\f$ of size N is stored as its only nonzero entries: lower(j) = A(j+1,j) for
+    * j < N-2, upper(j) = A(j,j+1) for j < N-1, and the last row.  On return these hold \f$\mathbf{D}^{-1}\mathbf{A}\mathbf{D}\f$,
+    * where D holds the diagonal of \f$\mathbf{D}\f$; the balancing is the same as is applied to dense matrices.
+    */
+    void balance_colleague(Eigen::VectorXd &lower, Eigen::VectorXd &upper, Eigen::VectorXd &lastrow, Eigen::VectorXd &D);
+    /// The real eigenvalues of the upper Hessenberg matrix A, from an eigenvalue-only QR iteration that does not accumulate Schur vectors
     Eigen::VectorXd eigenvalues_upperHessenberg(const Eigen::MatrixXd &A, bool balance);
 
+    /**
+    * @brief The colleague matrix of a Chebyshev series, stored in compact form
+    *
+    * Only the sub-diagonal, the super-diagonal and the last row of the colleague matrix are nonzero, so they are all
+    * that is stored between solves; construction, balancing and the matrix-vector product are O(N).  The eigenvalues
+    * are not: the QR iteration fills in the upper triangle, so each eigenvalue solve materializes the dense upper
+    * Hessenberg matrix (the transpose) and its real Schur form, two N x N matrices that are held for the duration of
+    * the solve, which is O(N^3) in operations.  A QR iteration on the compact form itself (structured, in O(N) memory)
+    * is not implemented.
+    *
+    * See Boyd, SIAM review, 2013, http://dx.doi.org/10.1137/110838297, Appendix A.2
+    */
+    class ColleagueMatrix {
+    private:
+        Eigen::VectorXd m_lower; ///< A(j+1,j) for j < N-2
+        Eigen::VectorXd m_upper; ///< A(j,j+1) for j < N-1
+        Eigen::VectorXd m_lastrow; ///< A(N-1,j) for j < N
+        Eigen::VectorXd m_D; ///< The diagonal of the balancing matrix, all ones until balanced
+    public:
+        /// The colleague matrix of the Chebyshev coefficients c, whose last coefficient must be nonzero, and of degree at least 2
+        explicit ColleagueMatrix(const Eigen::Ref<const Eigen::VectorXd> &c);
+        /// The size N of the matrix, the degree of the series
+        Eigen::Index size() const { return m_lastrow.size(); }
+        const Eigen::VectorXd &lower() const { return m_lower; }
+        const Eigen::VectorXd &upper() const { return m_upper; }
+        const Eigen::VectorXd &last_row() const { return m_lastrow; }
+        /// The diagonal of \f$\mathbf{D}\f$ in the balanced matrix \f$\mathbf{D}^{-1}\mathbf{A}\mathbf{D}\f$
+        const Eigen::VectorXd &balancing() const { return m_D; }
+        /// Balance the matrix in place with balance_colleague
+        ColleagueMatrix &balance();
+        /// The product of the matrix with a vector, in O(N) operations
+        Eigen::VectorXd operator*(const Eigen::VectorXd &v) const;
+        /// Materialize the dense (lower Hessenberg) colleague matrix
+        Eigen::MatrixXd dense() const;
+        /// Materialize the dense transpose, which is upper Hessenberg
+        Eigen::MatrixXd upper_Hessenberg() const;
+        /// All the eigenvalues, from a QR iteration on a dense N x N copy
+        Eigen::VectorXcd eigenvalues() const;
+        /// The real eigenvalues, filtered as in eigenvalues_upperHessenberg; also needs a dense N x N copy
+        Eigen::VectorXd real_eigenvalues() const;
+    };
+
+    /// A value together with a rigorous bound on its floating-point rounding error
+    struct ValueWithError {
+        double value; ///< The computed value
+        double error; ///< A bound on the absolute rounding error of value
+    };
+
+    /// A stationary point of a function, or the location of its global minimum or maximum
+    struct Extremum {
+        double x; ///< The value of the independent variable
+        double y; ///< The value of the function
+    };
+
+    /// Bounds that enclose the range of a function over an interval
+    struct RangeEnclosure {
+        double ymin; ///< A lower bound of the function over the interval
+        double ymax; ///< An upper bound of the function over the interval
+    };
+
+    /// An estimate of the singularity of a function that limits the convergence of its Chebyshev expansion
+    struct SingularityEstimate {
+        std::complex<double> z; ///< The location of the singularity, in the coordinates of x
+        double rho; ///< The parameter (sum of the semi-axes, in [-1,1]) of the Bernstein ellipse through z; the coefficients decay like \f$\rho^{-n}\f$
+        double misfit; ///< The relative residual of the fit to the coefficients, small when a single singularity dominates
+    };
+
+    /// Values together with rigorous bounds on their floating-point rounding errors
+    struct ValuesWithErrors {
+        Eigen::ArrayXd values; ///< The computed values
+        Eigen::ArrayXd errors; ///< Bounds on the absolute rounding errors of the values
+    };
+
     /**
     * @brief This is the main underlying object that makes all of the code of ChebTools work.
     *
@@ -66,18 +346,16 @@ namespace ChebTools{
     */
     class ChebyshevExpansion {
     private:
-        vectype m_c;
+        CoefficientStorage m_c;
         double m_xmin, m_xmax;
 
-        vectype m_recurrence_buffer;
         vectype m_nodal_value_cache;
-        void resize() {
-            m_recurrence_buffer.resize(m_c.size());
-        }
+
+        friend class ColleaguePencil;
 
         //reduce_zeros changes the m_c field so that our companion matrix doesnt have nan values in it
         //all this does is truncate m_c such that there are no trailing zero values
-        static Eigen::VectorXd reduce_zeros(const Eigen:: VectorXd &chebCoeffs){
+        static Eigen::VectorXd reduce_zeros(const Eigen::Ref<const Eigen::VectorXd> &chebCoeffs){
           //these give us a threshold for what coefficients are large enough
           double largeTerm = 1e-15;
           if (chebCoeffs.size()>=1 && std::abs(chebCoeffs(0))>largeTerm){
@@ -106,14 +384,16 @@ namespace ChebTools{
 
     public:
         /// Initializer with coefficients, and optionally a range provided
-        ChebyshevExpansion(const vectype &c, double xmin = -1, double xmax = 1) : m_c(c), m_xmin(xmin), m_xmax(xmax) { resize(); };
+        ChebyshevExpansion(const vectype &c, double xmin = -1, double xmax = 1) : m_xmin(xmin), m_xmax(xmax) { m_c.assign(c); };
         /// Initializer with coefficients, and optionally a range provided
         ChebyshevExpansion(const std::vector<double> &c, double xmin = -1, double xmax = 1) : m_xmin(xmin), m_xmax(xmax) {
-            m_c = Eigen::Map<const Eigen::VectorXd>(&(c[0]), c.size());
-            resize();
+            m_c.assign(Eigen::Map<const Eigen::VectorXd>(c.data(), c.size()));
         };
         /// Move constructor (C++11 only)
-        ChebyshevExpansion(const vectype &&c, double xmin = -1, double xmax = 1) : m_c(c), m_xmin(xmin), m_xmax(xmax) { resize(); };
+        ChebyshevExpansion(const vectype &&c, double xmin = -1, double xmax = 1) : m_xmin(xmin), m_xmax(xmax) { m_c.assign(c); };
+        /// Initializer from an Eigen expression; the expression is evaluated directly into the coefficient storage
+        template<typename Derived>
+        ChebyshevExpansion(const Eigen::DenseBase<Derived> &c, double xmin = -1, double xmax = 1) : m_xmin(xmin), m_xmax(xmax) { m_c.assign(c); };
 
         /// Cache nodal function values
         void cache_nodal_function_values(vectype values) {
@@ -132,11 +412,17 @@ namespace ChebTools{
             return ((m_xmax - m_xmin)*xscaled + (m_xmax + m_xmin))/2;
         }
 
-        /// Get the vector of coefficients in increasing order
-        const vectype &coef() const;
+        /// Get a view of the coefficients in increasing order, without copying; valid as long as the expansion is alive and unmodified
+        Eigen::Map<const vectype> coef() const & { return m_c.map(); }
+        /// Get a copy of the coefficients in increasing order of a temporary expansion, which would not outlive a view
+        vectype coef() const && { return m_c.map(); }
+        /// Get a non-owning view of the coefficients in increasing order; valid as long as the expansion is alive and unmodified
+        Eigen::Map<const vectype> coef_view() const { return m_c.map(); }
 
         /// Return the N-th derivative of this expansion, where N must be >= 1
         ChebyshevExpansion deriv(std::size_t Nderiv) const;
+        /// Replace this expansion by its first derivative, in O(N) operations and without reallocating the coefficients; cached nodal values are dropped
+        void deriv_inplace();
         /// Return the indefinite integral of this function
         ChebyshevExpansion integrate(std::size_t Nintegral = 1) const;
         /// Get the Chebyshev-Lobatto nodes in the domain [-1,1]
@@ -223,7 +509,7 @@ namespace ChebTools{
 
         /// Friend function that allows for pre-multiplication by a constant value
         friend ChebyshevExpansion operator*(double value, const ChebyshevExpansion &ce){
-            return ChebyshevExpansion(std::move(ce.coef()*value),ce.m_xmin, ce.m_xmax);
+            return ChebyshevExpansion(ce.coef_view()*value, ce.m_xmin, ce.m_xmax);
         };
         /// Friend function that allows expansion to be the denominator in division with double
         friend ChebyshevExpansion operator/(double value, const ChebyshevExpansion& ce) {
@@ -255,8 +541,9 @@ namespace ChebTools{
         /**
         * @brief Do a single input/single output evaluation of the Chebyshev expansion with the inputs scaled in [xmin, xmax]
         * @param x A value scaled in the domain [xmin,xmax]
+        * @note No state of the expansion is modified, so this is safe to call concurrently on a shared expansion
         */
-        double y_recurrence(const double x);
+        double y_recurrence(const double x) const;
         /**
         * @brief Do a single input/single output evaluation of the Chebyshev expansion with the inputs scaled in [xmin, xmax]
         * @param x A value scaled in the domain [xmin,xmax]
@@ -286,14 +573,49 @@ namespace ChebTools{
         * any additional work, "magical" vectorization is happening
         * under the hood, giving a significant speed improvement. From naive
         * testing, the increase was a factor of about 10x.
+        *
+        * The points are processed in blocks of recurrence_block_size with stack-allocated scratch,
+        * so the (npts x N+1) matrix of Chebyshev polynomial values is never formed
         */
         vectype y_recurrence_xscaled(const vectype &xscaled) const ;
+        /// The number of points evaluated together in y_recurrence_xscaled
+        static constexpr Eigen::Index recurrence_block_size = 64;
         /**
         * @brief Do a vectorized evaluation of the Chebyshev expansion with the input scaled in the domain [-1,1] with Clenshaw's method
         * @param xscaled A vectype of values scaled to the domain [-1,1] (the domain of the Chebyshev basis functions)
         * @returns y A vectype of values evaluated from the expansion
         */
         vectype y_Clenshaw_xscaled(const vectype &xscaled) const ;
+        /**
+        * @brief Evaluate the expansion with Clenshaw's method, together with a bound on the rounding error
+        * @param xscaled A value scaled in the domain [-1,1]
+        *
+        * Each step of the recurrence commits a rounding error \f$\delta_k\f$ that acts exactly as a perturbation of
+        * the coefficient \f$c_k\f$, so the error of the result is \f$\sum_k \delta_k T_k(x)\f$.  With
+        * \f$|\delta_k| \le \gamma_3(|2x\hat{u}_{k+1}| + |\hat{u}_{k+2}| + |c_k|)\f$ accumulated from the computed
+        * \f$\hat{u}\f$ as the recurrence runs (Higham's running error analysis), and \f$|T_k(x)|\le 1\f$ in
+        * [-1,1] (or \f$\le\rho^N\f$, \f$\rho=|x|+\sqrt{x^2-1}\f$, outside), the bound holds for any coefficients,
+        * including cancellation.  The rounding of the bound itself is covered by a small extra factor.
+        * The bound is for the polynomial at exactly the given xscaled; it does not include the error of the
+        * expansion as an approximation to some other function.
+        */
+        ValueWithError y_with_error_xscaled(const double xscaled) const;
+        /**
+        * @brief Evaluate the expansion with Clenshaw's method, together with a bound on the rounding error
+        * @param x A value in the domain [xmin,xmax]
+        *
+        * As y_with_error_xscaled, with the rounding of the scaling of x into [-1,1] also propagated into the
+        * bound through the Markov bound \f$|T_k'(x)|\le k^2\f$ on the derivative
+        */
+        ValueWithError y_with_error(const double x) const;
+        /**
+        * @brief Vectorized form of y_with_error
+        * @param x A vectype of values in the domain [xmin,xmax]
+        *
+        * The recurrence and the accumulation of the bound run together on blocks of points held on the stack,
+        * so this costs at most about twice the plain vectorized evaluation
+        */
+        ValuesWithErrors y_with_error(const vectype &x) const;
 
         /**
         * @brief Construct and return the companion matrix of the Chebyshev expansion
@@ -336,6 +658,114 @@ namespace ChebTools{
         */
         double monotonic_solvex(double yval) const;
 
+        /**
+        * @brief The global minimum of the expansion over [a, b], by branch and bound
+        * @param a The minimum value of x of the search
+        * @param b The maximum value of x of the search
+        *
+        * The best value found so far starts from the ends.  Pieces of [a, b] whose range_enclosure lies
+        * wholly above it cannot hold the minimum, and are dropped.  The surviving pieces are bisected until
+        * their re-expanded derivative is of low degree, and only then are its roots found.  This replaces
+        * rootfinding of the derivative of full degree, which is O(N^3), with restricts and small eigenvalue problems.
+        */
+        Extremum minimize(double a, double b) const;
+        /// The global minimum of the expansion over its domain
+        Extremum minimize() const { return minimize(m_xmin, m_xmax); }
+        /// The global maximum of the expansion over [a, b], as in minimize
+        Extremum maximize(double a, double b) const;
+        /// The global maximum of the expansion over its domain
+        Extremum maximize() const { return maximize(m_xmin, m_xmax); }
+        /// The value of x at the global minimum of the expansion over its domain
+        double argmin() const { return minimize().x; }
+        /// The value of x at the global maximum of the expansion over its domain
+        double argmax() const { return maximize().x; }
+        /// Surviving pieces are bisected until the degree of their derivative (trailing zeros dropped) is at most this
+        static constexpr Eigen::Index optimize_rootfind_degree = 16;
+        /// The number of bisections below which a surviving piece is root-found whatever its degree
+        static constexpr int optimize_max_depth = 12;
+
+        /// Return this expansion at the higher degree Nnew, padding the coefficients with zeros
+        ChebyshevExpansion prolong(std::size_t Nnew) const;
+        /// Return this expansion truncated to the lower degree Nnew, keeping the first Nnew+1 coefficients
+        ChebyshevExpansion truncate_to(std::size_t Nnew) const;
+        /**
+        * @brief Take values at the Chebyshev-Lobatto nodes of one degree to the nodes of degree Nnew
+        *
+        * This is the same as building the expansion with factoryf, prolonging or truncating it, and evaluating it at the new nodes,
+        * but done with one matrix that is cached for each pair of degrees
+        *
+        * @param f The values at the Chebyshev-Lobatto nodes of degree f.size()-1
+        * @param Nnew The new degree
+        */
+        static Eigen::VectorXd resample_nodal_values(const Eigen::VectorXd &f, std::size_t Nnew);
+
+        /**
+        * @brief Re-expand this expansion on the interval [a, b], keeping the degree
+        *
+        * This is done in coefficient space, without resampling: Clenshaw's recurrence is carried out
+        * with the scalar argument replaced by the operator that multiplies an expansion in [a, b] by
+        * the affine map from [a, b] into [-1, 1] of this expansion, which costs O(N) per step, or O(N^2) in total.
+        * The interval [a, b] may extend beyond [xmin, xmax], in which case the expansion is extrapolated.
+        *
+        * Above degree restrict_FFT_threshold, the expansion is instead sampled at the Chebyshev-Lobatto
+        * nodes of [a, b] and the coefficients are obtained with factoryfFFT.
+        *
+        * @param a The new minimum value of x
+        * @param b The new maximum value of x
+        */
+        ChebyshevExpansion restrict(double a, double b) const;
+        /// The degree above which restrict samples and uses the FFT rather than working in coefficient space
+        static constexpr Eigen::Index restrict_FFT_threshold = 48;
+
+        /**
+        * @brief Re-expand this expansion on each of the consecutive intervals [breakpoints[i], breakpoints[i+1]]
+        *
+        * All the sub-intervals are handled together: the expansion is evaluated with Clenshaw's method at the
+        * Chebyshev-Lobatto nodes of every sub-interval at once, and the nodal values are converted
+        * to coefficients with a single matrix-matrix product.
+        *
+        * @param breakpoints The increasing values of x that bound the sub-intervals
+        * @param Ndegree The degree of the new expansions; if negative, the degree of this expansion is used
+        */
+        std::vector<ChebyshevExpansion> restrict_batch(const std::vector<double>& breakpoints, int Ndegree = -1) const;
+
+        /**
+        * @brief Bound the range of the expansion over [a, b]
+        * @param a The minimum value of x of the sub-interval
+        * @param b The maximum value of x of the sub-interval
+        * @param max_bisections The number of bisections allowed to tighten the bounds
+        *
+        * The expansion is re-expanded on [a, b] with restrict, and since \f$|T_k|\le 1\f$ there, the range is
+        * contained in \f$c_0 \pm \sum_{k\ge 1}|c_k|\f$, widened by a small allowance for the rounding of the
+        * re-expansion.  This costs one restrict, with no sampling.  With a budget of bisections, the sub-interval
+        * whose bound is the furthest from the values found at the ends of the pieces is split, and its halves are
+        * bounded the same way; the bounds can only get tighter.
+        */
+        RangeEnclosure range_enclosure(double a, double b, std::size_t max_bisections = 0) const;
+        /**
+        * @brief Bound the range of the expansion over each of the consecutive sub-intervals [breakpoints[i], breakpoints[i+1]]
+        * @param breakpoints The increasing values of x that bound the sub-intervals
+        * @param max_bisections The number of bisections allowed to tighten the bounds of each sub-interval
+        * @param Nthreads The number of threads used when there are bisections to be done
+        *
+        * Without bisections, all the sub-intervals are re-expanded together with restrict_batch
+        */
+        std::vector<RangeEnclosure> range_enclosure_batch(const std::vector<double>& breakpoints, std::size_t max_bisections = 0, int Nthreads = 1) const;
+        /// True if the value y might be taken by the expansion in its domain, from the bound \f$c_0 \pm \sum_{k\ge 1}|c_k|\f$; O(N) and without any restrict
+        bool might_take_value(double y) const;
+
+        /**
+        * @brief Estimate the location of the singularity nearest to the domain from the decay of the coefficients
+        *
+        * A singularity at z (in [-1,1] coordinates) makes the coefficients behave like \f$\mathrm{Re}(A r^n)\f$ with
+        * \f$1/r = z + \sqrt{z^2-1}\f$, whose modulus is the parameter of the Bernstein ellipse through z.  Such a sequence
+        * satisfies \f$c_{n+2} = p c_{n+1} + q c_n\f$, which is fit in the least-squares sense to the upper half of the
+        * coefficients above the rounding level; the root r of \f$r^2 - pr - q\f$ of largest modulus gives
+        * \f$z = (r + 1/r)/2\f$, which is mapped into [xmin, xmax].  If there are too few coefficients above the
+        * rounding level to fit, z is NaN.
+        */
+        SingularityEstimate nearest_singularity() const;
+
         /**
         * @brief Subdivide the original interval into a set of subintervals that are linearly spaced
         * @note A vector of ChebyshevExpansions are returned
@@ -413,6 +843,27 @@ namespace ChebTools{
             return factoryf(N, f, xmin, xmax);
         };
 
+        /**
+        * @brief Given a callable function, construct the N-th order Chebyshev expansion in [xmin, xmax], with the degree fixed at compile time
+        * @param func A callable object, taking the x value (in [xmin,xmax]) and returning the y value
+        * @param xmin The minimum x value for the fit
+        * @param xmax The maximum x value for the fit
+        *
+        * Equivalent to factory(N, func, xmin, xmax), but the nodes and the matrix L come from ChebyshevLobattoTables<N>,
+        * so the function values and the transform are fixed-size and the only allocation is the returned coefficients.
+        */
+        template<std::size_t N, class double_function>
+        static ChebyshevExpansion factory_fixed(double_function func, const double xmin, const double xmax)
+        {
+            using Tables = ChebyshevLobattoTables<N>;
+            typename Tables::Vector f;
+            for (std::size_t k = 0; k <= N; ++k) {
+                f(k) = func(((xmax - xmin)*Tables::nodes[k] + (xmax + xmin)) / 2.0);
+            }
+            typename Tables::Vector c = Tables::L_map()*f;
+            return ChebyshevExpansion(Eigen::VectorXd(c), xmin, xmax);
+        };
+
         /// Convert a monomial term in the form \f$x^n\f$ to a Chebyshev expansion
         static ChebyshevExpansion from_powxn(const std::size_t n, const double xmin, const double xmax);
 
@@ -446,7 +897,7 @@ namespace ChebTools{
         {
             
             // Convenience function to get the M-element norm
-            auto get_err = [M](const ChebyshevExpansion& ce) { return ce.coef().tail(M).norm() / ce.coef().head(M).norm(); };
+            auto get_err = [M](const ChebyshevExpansion& ce) { return ce.coef_view().tail(M).norm() / ce.coef_view().head(M).norm(); };
             
             // Start off with the full domain from xmin to xmax
             Container expansions;
@@ -464,7 +915,7 @@ namespace ChebTools{
                         auto xmid = (expan.xmin() + expan.xmax()) / 2;
                         auto newleft = ChebyshevExpansion::factory(N, func, expan.xmin(), xmid);
                         auto newright = ChebyshevExpansion::factory(N, func, xmid, expan.xmax());
-                        using ArrayType = decltype(newleft.coef());
+                        using ArrayType = decltype(newleft.coef_view());
 
                         // Function to check if any coefficients are invalid (evidence of a bad function value)
                         auto all_coeffs_ok = [](const ArrayType& v) {
@@ -474,7 +925,7 @@ namespace ChebTools{
                             return true; 
                         };
                         // Check if any coefficients are invalid, stop if so
-                        if (!all_coeffs_ok(newleft.coef()) || !all_coeffs_ok(newright.coef())) {
+                        if (!all_coeffs_ok(newleft.coef_view()) || !all_coeffs_ok(newright.coef_view())) {
                             throw std::invalid_argument("At least one coefficient is non-finite");
                         }
                         std::swap(expan, newleft);
@@ -489,8 +940,256 @@ namespace ChebTools{
             }
             return expansions;
         }
+
+        /**
+        * @brief Like dyadic_splitting, but each expansion that has not converged is split where it is most useful
+        *
+        * The singularity that limits the convergence is located with nearest_singularity.  From its Bernstein ellipse
+        * parameter with respect to candidate pieces, the split is placed to cut off the widest piece at the end away from
+        * the singularity that is expected to meet the tolerance, if that is at least half of the expansion; a feature near
+        * one end then costs one new expansion per pass rather than several.  Otherwise, a singularity close to the interior
+        * of the expansion is split at, so that it ends up at the ends of the new expansions, and in all other cases
+        * (a poor fit, as for a smooth function that is not yet resolved, or a cut-off piece that does not converge after
+        * all) the split is at the midpoint as in dyadic_splitting.  Splits are at least a fraction
+        * adaptive_min_split_fraction of the width from either end.
+        *
+        * With merge, once the refinement is done each pair of neighbouring converged expansions is replaced by a single
+        * expansion over both of them if that one also meets the tolerance, working from left to right.
+        *
+        * The arguments are as for dyadic_splitting
+        */
+        template<typename Container = std::deque<ChebyshevExpansion>>
+        static auto adaptive_splitting(const std::size_t N, const std::function<double(double)>& func, const double xmin, const double xmax,
+            const int M, const double tol, const int max_refine_passes = 8, const bool merge = true,
+            const std::function<void(int, const Container&)>&callback = {}) -> Container
+        {
+            auto get_err = [M](const ChebyshevExpansion& ce) { return ce.coef_view().tail(M).norm() / ce.coef_view().head(M).norm(); };
+            auto all_coeffs_ok = [](const ChebyshevExpansion& ce) { return ce.coef_view().allFinite(); };
+            // The Bernstein ellipse parameter at which the last M coefficients are expected to decay below tol
+            const double rho_needed = std::pow(tol, -1.0/static_cast<double>(N + 1 - M));
+            // The location of the split, and whether the piece to the left (-1) or right (+1) of it is expected to converge
+            auto split_location = [rho_needed](const ChebyshevExpansion& ce) -> std::pair<double, int> {
+                const double a = ce.xmin(), b = ce.xmax(), xmid = (a + b) / 2, g = adaptive_min_split_fraction;
+                auto sing = ce.nearest_singularity();
+                if (!(sing.misfit < adaptive_max_misfit) || !(sing.rho >= 1)) {
+                    return { xmid, 0 };
+                }
+                // The singularity in [-1,1], and its ellipse parameter with respect to the piece [lo, hi] of [-1,1]
+                const std::complex<double> z = (2.0*sing.z - (a + b))/(b - a);
+                auto rho_of = [&z](double lo, double hi) {
+                    const std::complex<double> t = (2.0*z - (lo + hi))/(hi - lo), w = t + std::sqrt(t*t - 1.0);
+                    return std::max(std::abs(w), 1/std::abs(w));
+                };
+                const double smin = -1 + 2*g, smax = 1 - 2*g;
+                const bool keep_left = z.real() > 0;
+                auto converges = [&](double s) { return (keep_left) ? rho_of(-1, s) >= rho_needed : rho_of(s, 1) >= rho_needed; };
+                if (!converges(0)) {
+                    // Not even the half furthest from the singularity is expected to converge, so put the singularity
+                    // at the ends of the new pieces if it is inside this one, otherwise bisect
+                    if (sing.rho < adaptive_max_interior_rho && z.real() > smin && z.real() < smax) {
+                        return { a + (z.real() + 1)/2*(b - a), 0 };
+                    }
+                    return { xmid, 0 };
+                }
+                // Bisect for the widest piece at the end furthest from the singularity that is expected to converge
+                double sgood = 0, sbad = (keep_left) ? smax : smin;
+                if (converges(sbad)) {
+                    sgood = sbad;
+                }
+                for (int i = 0; i < 30 && sgood != sbad; ++i) {
+                    const double s = (sgood + sbad)/2;
+                    if (converges(s)) { sgood = s; } else { sbad = s; }
+                }
+                return { a + (sgood + 1)/2*(b - a), (keep_left) ? -1 : 1 };
+            };
+
+            Container expansions;
+            expansions.emplace_back(ChebyshevExpansion::factory(N, func, xmin, xmax));
+
+            for (int refine_pass = 0; refine_pass < max_refine_passes; ++refine_pass) {
+                bool all_converged = true;
+                // Start at the right and move left because insertions will make the length increase
+                for (int iexpansion = static_cast<int>(expansions.size())-1; iexpansion >= 0; --iexpansion) {
+                    auto& expan = expansions[iexpansion];
+                    if (get_err(expan) > tol) {
+                        auto [xsplit, converging_side] = split_location(expan);
+                        auto newleft = ChebyshevExpansion::factory(N, func, expan.xmin(), xsplit);
+                        auto newright = ChebyshevExpansion::factory(N, func, xsplit, expan.xmax());
+                        // If the piece that was expected to converge did not, the estimate was poor; fall back to a dyadic split
+                        if (converging_side != 0 && get_err((converging_side < 0) ? newleft : newright) > tol) {
+                            const double xmid = (expan.xmin() + expan.xmax()) / 2;
+                            newleft = ChebyshevExpansion::factory(N, func, expan.xmin(), xmid);
+                            newright = ChebyshevExpansion::factory(N, func, xmid, expan.xmax());
+                        }
+                        if (!all_coeffs_ok(newleft) || !all_coeffs_ok(newright)) {
+                            throw std::invalid_argument("At least one coefficient is non-finite");
+                        }
+                        std::swap(expan, newleft);
+                        expansions.insert(expansions.begin() + iexpansion+1, newright);
+                        all_converged = false;
+                    }
+                }
+                if (callback != nullptr) {
+                    callback(refine_pass, expansions);
+                }
+                if (all_converged) { break; }
+            }
+            if (merge) {
+                for (std::size_t i = 0; i + 1 < expansions.size(); ) {
+                    if (get_err(expansions[i]) <= tol && get_err(expansions[i + 1]) <= tol) {
+                        auto joined = ChebyshevExpansion::factory(N, func, expansions[i].xmin(), expansions[i + 1].xmax());
+                        if (all_coeffs_ok(joined) && get_err(joined) <= tol) {
+                            // Stay at i, since the joined expansion might also be joined with the next one
+                            std::swap(expansions[i], joined);
+                            expansions.erase(expansions.begin() + i + 1);
+                            continue;
+                        }
+                    }
+                    ++i;
+                }
+            }
+            return expansions;
+        }
+        /// The least fraction of the width of an expansion that adaptive_splitting leaves on either side of a split
+        static constexpr double adaptive_min_split_fraction = 0.1;
+        /// The largest misfit of nearest_singularity for which adaptive_splitting uses it to place a split
+        static constexpr double adaptive_max_misfit = 0.35;
+        /// The largest Bernstein ellipse parameter of a singularity that adaptive_splitting places a split at
+        static constexpr double adaptive_max_interior_rho = 1.5;
+    };
+
+    /**
+    * @brief Real roots of \f$f(x)-c\f$ for many values of the constant c, from one colleague matrix
+    *
+    * Shifting the expansion by c only changes its first coefficient, which is a rank-one change to a single entry of
+    * the (transposed) colleague matrix.  The work that does not depend on c is done once, on first use by either
+    * kind of query: for the roots in the domain, the colleague matrix of f' is solved for the stationary points, which
+    * split [-1,1] into intervals on which f is monotonic, and each shift then costs a bracketed Newton solve on each
+    * monotonic interval whose values straddle c, which is O(N) per root.  When the roots outside the domain are also
+    * wanted, the colleague matrix of f is balanced and kept as a dense Hessenberg matrix, and each shift costs a patch
+    * of the corner entry and a full O(N^3) QR iteration on a copy of it; only the balancing is shared between shifts.
+    */
+    class ColleaguePencil {
+    private:
+        /// The ends of the monotonic intervals in [-1,1], including -1 and 1, and the values of the expansion there
+        struct MonotonicIntervals {
+            std::vector<double> t, ft;
+        };
+        /// The balanced, transposed colleague matrix of the unshifted expansion
+        struct ShiftableHessenberg {
+            Eigen::MatrixXd H;
+            double dcorner = 0; ///< The change of the corner entry of H per unit shift
+        };
+        Eigen::VectorXd m_c; ///< The coefficients with trailing zeros removed
+        double m_xmin, m_xmax;
+        ChebyshevExpansion m_f, m_df; ///< The expansion and its derivative in [-1,1]
+        /// Built on first use, and published once so that concurrent shifts can share them
+        mutable std::shared_ptr<const MonotonicIntervals> m_intervals;
+        mutable std::shared_ptr<const ShiftableHessenberg> m_hessenberg;
+        std::shared_ptr<const MonotonicIntervals> get_intervals() const;
+        std::shared_ptr<const ShiftableHessenberg> get_hessenberg() const;
+        std::vector<double> roots_in_domain(double c) const;
+        std::vector<double> eigenvalue_roots(double c, bool only_in_domain) const;
+    public:
+        /// Build the pencil for the expansion ce
+        explicit ColleaguePencil(const ChebyshevExpansion &ce);
+        /// The real roots of \f$f(x)-c\f$, sorted in increasing order
+        std::vector<double> real_roots(double c, bool only_in_domain = true) const {
+            return (only_in_domain) ? roots_in_domain(c) : eigenvalue_roots(c, only_in_domain);
+        }
+        /// The real roots of \f$f(x)-c\f$ for each of the values of c, as from the scalar overload, shared over Nthreads threads (all the hardware threads if zero or negative)
+        std::vector<std::vector<double>> real_roots(const std::vector<double> &cs, bool only_in_domain = true, int Nthreads = 1) const;
     };
 
+    /**
+    * @brief Batch operations on many expansions or many values, to amortize the cost of calls from Python
+    *
+    * Each takes an optional number of threads (all the hardware threads if zero or negative), over which the items are shared.
+    */
+    /// The values of each expansion (rows) at each of the values of x (columns)
+    Eigen::ArrayXXd evaluate_many(const std::vector<ChebyshevExpansion> &exps, const Eigen::Ref<const Eigen::ArrayXd> &x, int Nthreads = 1);
+    /// The real roots of each of the expansions, as from ChebyshevExpansion::real_roots
+    std::vector<std::vector<double>> real_roots_many(const std::vector<ChebyshevExpansion> &exps, bool only_in_domain = true, int Nthreads = 1);
+    /// The solutions of ChebyshevExpansion::monotonic_solvex for each of the values of y; values of y out of range give NaN
+    Eigen::ArrayXd monotonic_solvex_many(const ChebyshevExpansion &ce, const Eigen::Ref<const Eigen::ArrayXd> &ys, int Nthreads = 1);
+
+
+    /// A small class that implements a Taylor expansion around a particular point
+    template<typename CoefType>
+    class TaylorExtrapolator {
+    private:
+        const CoefType coef; ///< The coefficients: c = {f(x), f'(x), f''(x), f'''(x), ...}
+        const double x0; ///< Point around which the derivatives are taken
+        const int degree; ///< The degree of the expansion
+        const CoefType taylor; ///< The coefficients of the Taylor series: c_n/n!
+
+        static CoefType divide_by_factorials(CoefType c) {
+            double factorial = 1;
+            for (auto n = 1; n < c.size(); ++n) {
+                factorial *= n;
+                c[n] /= factorial;
+            }
+            return c;
+        }
+    public:
+
+        /***
+        * @param coef The coefficients, the values of the function and its derivatives at the point x, c = {f(x), f'(x), f''(x), f'''(x)}
+        * @param x The point around which the expansion is based
+        */
+        TaylorExtrapolator(const CoefType &coef, double x) : coef(coef), x0(x), degree(static_cast<int>(coef.size()-1)), taylor(divide_by_factorials(coef)){}
+
+        /// Evaluate the Taylor series with Horner's method; XType can be a double or an Eigen array
+        template<typename XType>
+        XType operator()(const XType &x) const {
+            const XType dx = x - x0;
+            XType o = 0.0*dx + taylor[degree];
+            for (auto n = degree - 1; n >= 0; --n) {
+                o = o*dx + taylor[n];
+            }
+            return o;
+        }
+
+        auto get_coef(){
+            return coef;
+        }
+        /// The degree of the Taylor series
+        int get_degree() const { return degree; }
+
+
+    };
+
+    /**
+    * @brief A factory function to make a Taylor extrapolator from a Chebyshev expansion of given degree around the position x
+    *
+    * The derivatives are obtained in a single pass, differentiating one working copy of the expansion in place
+    */
+    static auto make_Taylor_extrapolator(const ChebyshevExpansion &ce, double x, int degree) {
+        Eigen::ArrayXd c(degree + 1);
+        ChebyshevExpansion d = ce;
+        for (auto n = 0; n <= degree; ++n) {
+            c[n] = d.y_Clenshaw(x);
+            if (n < degree) {
+                d.deriv_inplace();
+            }
+        }
+        return TaylorExtrapolator<decltype(c)>(c, x);
+    }
+
+    /// A range of the independent variable over which a function is monotonic
+    struct MonotonicRange {
+        double xmin; ///< The lower bound of the range
+        double xmax; ///< The upper bound of the range
+        bool increasing; ///< True if the function increases from xmin to xmax
+    };
+
+    /// The stationary points of a ChebyshevCollection, and the quantities derived from them
+    struct ExtremaCache {
+        std::vector<Extremum> extrema; ///< Points at which dy/dx = 0, sorted in increasing x
+        std::vector<MonotonicRange> monotonic_ranges; ///< The domain split at the extrema
+        Extremum global_min; ///< The global minimum over the whole domain
+        Extremum global_max; ///< The global maximum over the whole domain
+    };
 
     class ChebyshevCollection {
     public:
@@ -498,6 +1197,15 @@ namespace ChebTools{
     private:
         Container m_exps;
 
+        using Extrapolator = TaylorExtrapolator<Eigen::ArrayXd>;
+        /// Extrapolators around xmin and xmax, only present if extrapolation has been enabled
+        std::shared_ptr<const Extrapolator> m_left_extrapolator, m_right_extrapolator;
+
+        /// Lazily-built extrema; immutable once built, so copies of the collection can share it
+        mutable std::shared_ptr<const ExtremaCache> m_extrema_cache;
+        /// Find the extrema of each expansion, shared over Nthreads threads (all the hardware threads if zero or negative), and build the cache
+        std::shared_ptr<const ExtremaCache> build_extrema_cache(int Nthreads) const;
+
         /// Return the index of the expansion that is desired
         int get_index(double x) const {
             int iL = 0, iR = static_cast<int>(m_exps.size()) - 1, iM;
@@ -513,6 +1221,14 @@ namespace ChebTools{
             return (x < m_exps[iL].xmax()) ? iL : iR;
         };
 
+        /// Iterators to the extrema in ext with x in the range [a, b)
+        static auto extrema_in(const std::vector<Extremum>& ext, double a, double b) {
+            auto lt = [](const Extremum& e, double x) { return e.x < x; };
+            auto first = std::lower_bound(ext.begin(), ext.end(), a, lt);
+            auto last = std::lower_bound(first, ext.end(), b, lt);
+            return std::make_pair(first, last);
+        }
+
     public:
         ChebyshevCollection(const Container & exps) : m_exps(exps) {
 
@@ -531,24 +1247,54 @@ namespace ChebTools{
             return m_exps;
         }
 
-        /// Get a mutable reference to the set of expansions
+        /// Get a mutable reference to the set of expansions; this drops the cached extrema, which are rebuilt on next use
         auto& get_exps_mutable() {
+            std::atomic_store(&m_extrema_cache, std::shared_ptr<const ExtremaCache>());
             return m_exps;
         }
 
+        /**
+        * @brief Get the cached extrema of the collection, building the cache on first use
+        *
+        * The stationary points are obtained from the roots of the derivative of each expansion with
+        * ChebyshevExpansion::real_roots.  Concurrent callers are safe: at worst the cache is built more than once, and
+        * only the first one to be published is kept and returned to all of them.  The cache is shared, so it stays valid
+        * for as long as the returned pointer is held, even if get_exps_mutable drops it from the collection.
+        *
+        * @param Nthreads The number of threads over which the expansions are shared if the cache has to be built (all the hardware threads if zero or negative)
+        */
+        std::shared_ptr<const ExtremaCache> get_extrema_cache(int Nthreads = 1) const {
+            auto cache = std::atomic_load(&m_extrema_cache);
+            if (!cache) {
+                auto built = build_extrema_cache(Nthreads);
+                // If another thread published first, the exchange fails and loads its cache into cache
+                if (std::atomic_compare_exchange_strong(&m_extrema_cache, &cache, built)) {
+                    cache = built;
+                }
+            }
+            return cache;
+        }
+
         /**
         * Get the value of the independent variable at the extrema for which dy/dx = 0
         */
         auto get_extrema() const {
             std::vector<double> x;
-            for (auto& ex : m_exps) {
-                for (auto rt : ex.deriv(1).real_roots(true)) {
-                    x.push_back(rt);
-                }
+            for (auto& ext : get_extrema_cache()->extrema) {
+                x.push_back(ext.x);
             }
             return x;
         }
 
+        /// Get the stationary points (x and y) for which dy/dx = 0, sorted in increasing x
+        std::vector<Extremum> get_extrema_points() const { return get_extrema_cache()->extrema; }
+        /// Get the decomposition of the domain into ranges over which the collection is monotonic
+        std::vector<MonotonicRange> get_monotonic_ranges() const { return get_extrema_cache()->monotonic_ranges; }
+        /// Get the location and value of the global minimum over the domain
+        Extremum global_min() const { return get_extrema_cache()->global_min; }
+        /// Get the location and value of the global maximum over the domain
+        Extremum global_max() const { return get_extrema_cache()->global_max; }
+
         /**
          * \brief Obtain the value from the expansion
          * Throws if input value is outside the range of the collection
@@ -556,9 +1302,11 @@ namespace ChebTools{
         auto operator ()(double x) const{
             auto xmin = m_exps[0].xmin(), xmax = m_exps.back().xmax();
             if (x < xmin){
+                if (m_left_extrapolator) { return (*m_left_extrapolator)(x); }
                 throw std::invalid_argument("Provided value of " + std::to_string(x) + " is less than xmin of "+ std::to_string(xmin));
             }
             if (x > xmax){
+                if (m_right_extrapolator) { return (*m_right_extrapolator)(x); }
                 throw std::invalid_argument("Provided value of " + std::to_string(x) + " is greater than xmax of "+ std::to_string(xmax));
             }
             // Bisection to find the expansion we need
@@ -567,9 +1315,74 @@ namespace ChebTools{
             return m_exps[i].y(x);
         };
 
+        /**
+         * \brief Obtain the values from the expansion for an array of inputs
+         * Throws if any input value is outside the range of the collection, unless extrapolation is enabled
+         */
+        Eigen::ArrayXd operator ()(const Eigen::Ref<const Eigen::ArrayXd>& x) const {
+            const double xmin = m_exps[0].xmin(), xmax = m_exps.back().xmax();
+            Eigen::ArrayXd y(x.size());
+            int i = -1;
+            for (Eigen::Index j = 0; j < x.size(); ++j) {
+                if (x[j] < xmin || x[j] > xmax) {
+                    y[j] = (*this)(x[j]);
+                    continue;
+                }
+                // Successive inputs are often close to each other, so search outward from the last interval
+                i = get_galloping_index(x[j], i);
+                y[j] = m_exps[i].y_Clenshaw(x[j]);
+            }
+            return y;
+        }
+
+        /**
+        * @brief Allow evaluation outside [xmin, xmax] with Taylor series around the ends of the domain
+        * @param degree The degree of the Taylor series; a negative value disables extrapolation again
+        */
+        void set_Taylor_extrapolation(int degree) {
+            if (degree < 0) {
+                m_left_extrapolator.reset(); m_right_extrapolator.reset();
+                return;
+            }
+            const auto &left = m_exps.front(), &right = m_exps.back();
+            m_left_extrapolator = std::make_shared<const Extrapolator>(make_Taylor_extrapolator(left, left.xmin(), degree));
+            m_right_extrapolator = std::make_shared<const Extrapolator>(make_Taylor_extrapolator(right, right.xmax(), degree));
+        }
+        /// True if evaluation outside [xmin, xmax] uses Taylor extrapolation rather than throwing
+        bool is_extrapolating() const { return static_cast<bool>(m_left_extrapolator); }
+        /// The degree of the Taylor extrapolation, or -1 if the collection is not extrapolating
+        int get_Taylor_extrapolation() const { return (m_left_extrapolator) ? m_left_extrapolator->get_degree() : -1; }
+
+        /**
+        * @brief The maximum value of the collection over [a, b]
+        *
+        * Obtained from the cached extrema and the values at the two ends of the range
+        */
+        double max_on(double a, double b) const {
+            if (a > b) { std::swap(a, b); }
+            double m = std::max((*this)(a), (*this)(b));
+            const auto cache = get_extrema_cache();
+            auto [first, last] = extrema_in(cache->extrema, a, b);
+            for (auto it = first; it != last; ++it) { m = std::max(m, it->y); }
+            return m;
+        }
+        /**
+        * @brief The minimum value of the collection over [a, b]
+        *
+        * Obtained from the cached extrema and the values at the two ends of the range
+        */
+        double min_on(double a, double b) const {
+            if (a > b) { std::swap(a, b); }
+            double m = std::min((*this)(a), (*this)(b));
+            const auto cache = get_extrema_cache();
+            auto [first, last] = extrema_in(cache->extrema, a, b);
+            for (auto it = first; it != last; ++it) { m = std::min(m, it->y); }
+            return m;
+        }
+
         // Search for desired expansion, but first check the given hinted index
         // to short circuit the interval bisection if possible
-        auto get_hinted_index(double x, const int i) const {
+        int get_hinted_index(double x, const int i) const {
             if (i < 0 || i > m_exps.size()-1){
                 return get_index(x);
             }
@@ -584,6 +1397,81 @@ namespace ChebTools{
             }
         }
 
+        /**
+        * @brief Search for the expansion containing x, outward from a hinted index
+        *
+        * The hinted expansion and then its neighbour on the side of x are checked first.  Failing those, the search gallops
+        * away from the hint in steps of 2, 4, 8, ... expansions until x is bracketed, and then bisects the bracket, so the cost
+        * is \f$O(\log d)\f$ for x in an expansion d away from the hint rather than \f$O(\log n)\f$ for all n expansions.
+        * An invalid hint falls back to bisection over the whole collection.
+        */
+        int get_galloping_index(double x, const int hint) const {
+            const int n = static_cast<int>(m_exps.size());
+            if (hint < 0 || hint >= n) {
+                return get_index(x);
+            }
+            if (x >= m_exps[hint].xmin()) {
+                if (x <= m_exps[hint].xmax() || hint == n - 1) {
+                    return hint;
+                }
+                // Invariant: x is above the xmax of iL, and below the xmax of iR unless iR is the last
+                int iL = hint, iR = hint + 1, step = 1;
+                while (iR < n - 1 && m_exps[iR].xmax() < x) {
+                    iL = iR; step *= 2; iR = std::min(hint + step, n - 1);
+                }
+                while (iR - iL > 1) {
+                    const int iM = midpoint_Knuth(iL, iR);
+                    if (m_exps[iM].xmax() < x) { iL = iM; } else { iR = iM; }
+                }
+                return iR;
+            }
+            if (hint == 0) {
+                return 0;
+            }
+            // Invariant: x is below the xmin of iR, and above the xmin of iL unless iL is the first
+            int iL = hint - 1, iR = hint, step = 1;
+            while (iL > 0 && m_exps[iL].xmin() > x) {
+                iR = iL; step *= 2; iL = std::max(hint - step, 0);
+            }
+            while (iR - iL > 1) {
+                const int iM = midpoint_Knuth(iL, iR);
+                if (m_exps[iM].xmin() <= x) { iL = iM; } else { iR = iM; }
+            }
+            return iL;
+        }
+
+        /// Get the breakpoints of the collection: the xmin of each expansion, followed by the xmax of the last one
+        std::vector<double> get_breakpoints() const;
+
+        // ******************************************************************
+        // ***********************      OPERATORS     ***********************
+        // ******************************************************************
+
+        /**
+        * @brief Combine two collections piece by piece
+        *
+        * The breakpoints of the two collections are merged, the expansions of each collection are restricted
+        * with ChebyshevExpansion::restrict to the common sub-intervals, and the restricted expansions are combined
+        * with the given operation.  Both collections must span the same domain.  An exception thrown by op is
+        * passed on to the caller.
+        *
+        * @param other The other collection
+        * @param op The operation to apply to a pair of expansions defined on the same sub-interval
+        * @param Nthreads The number of threads over which the sub-intervals are shared (all the hardware threads if zero
+        * or negative); op must be safe to call concurrently unless this is 1
+        */
+        ChebyshevCollection combine(const ChebyshevCollection& other, const std::function<ChebyshevExpansion(const ChebyshevExpansion&, const ChebyshevExpansion&)>& op, int Nthreads = 1) const;
+        /// Piecewise sum of two collections
+        ChebyshevCollection operator+(const ChebyshevCollection& other) const;
+        /// Piecewise difference of two collections
+        ChebyshevCollection operator-(const ChebyshevCollection& other) const;
+        /// Piecewise product of two collections
+        ChebyshevCollection operator*(const ChebyshevCollection& other) const;
+        /// Piecewise quotient of two collections
+        ChebyshevCollection operator/(const ChebyshevCollection& other) const;
+        /// Apply a function to each expansion of the collection, see ChebyshevExpansion::apply
+        ChebyshevCollection apply(std::function<Eigen::ArrayXd(const Eigen::ArrayXd &)> &f) const;
+
         auto integrate(double xmin, double xmax) const {
             // Bisection to find the expansions we need
             auto imin = get_index(xmin), imax = get_index(xmax);
@@ -616,6 +1504,8 @@ namespace ChebTools{
         auto solve_for_x(double y) const {
             std::vector<double> solns;
             for (auto& ex : m_exps) {
+                // Skip the rootfinding where y is outside the bound on the range of the expansion
+                if (!ex.might_take_value(y)) { continue; }
                 bool only_in_domain = true;
                 for (auto& rt : (ex - y).real_roots2(only_in_domain)) {
                     solns.emplace_back(rt);
@@ -624,6 +1514,27 @@ namespace ChebTools{
             return solns;
         }
 
+        /// Solve for the values of x at each of the values of y; the expansions are each reduced to a ColleaguePencil once, and reused for all the values of y
+        std::vector<std::vector<double>> solve_for_x(const std::vector<double> &ys) const {
+            std::vector<std::vector<double>> solns(ys.size());
+            std::vector<double> ys_in;
+            std::vector<std::size_t> index;
+            for (auto& ex : m_exps) {
+                // Only the values of y within the bound on the range of the expansion need the pencil
+                const RangeEnclosure range = ex.range_enclosure(ex.xmin(), ex.xmax());
+                ys_in.clear(); index.clear();
+                for (std::size_t i = 0; i < ys.size(); ++i) {
+                    if (ys[i] >= range.ymin && ys[i] <= range.ymax) { ys_in.push_back(ys[i]); index.push_back(i); }
+                }
+                if (ys_in.empty()) { continue; }
+                auto roots = ColleaguePencil(ex).real_roots(ys_in);
+                for (std::size_t j = 0; j < ys_in.size(); ++j) {
+                    solns[index[j]].insert(solns[index[j]].end(), roots[j].begin(), roots[j].end());
+                }
+            }
+            return solns;
+        }
+
         /** 
         * @brief Make an inverse collection for x(y) from this collection
         *
@@ -714,47 +1625,287 @@ namespace ChebTools{
         }
     };
 
-    /// A small class that implements a Taylor expansion around a particular point
-    template<typename CoefType>
-    class TaylorExtrapolator {
+    /**
+    * @brief A position in a ChebyshevCollection for evaluating streams of inputs that move slowly
+    *
+    * The cursor remembers the expansion used for the last input, and the next input is located with
+    * ChebyshevCollection::get_galloping_index starting from there, so inputs that stay in the same expansion or move into
+    * a neighbour cost a comparison or two instead of a bisection over all the expansions.
+    *
+    * The cursor only reads the collection, which must outlive it.  Each thread should have its own cursor; many cursors
+    * can share one const collection without locking.
+    */
+    class CollectionCursor {
     private:
-        const CoefType coef; ///< The coefficients: c = {f(x), f'(x), f''(x), f'''(x), ...}
-        const double x0; ///< Point around which the derivatives are taken
-        const int degree; ///< The degree of the expansion
+        const ChebyshevCollection *m_cc;
+        int m_index = -1; ///< The index of the last expansion used, or -1 before the first input
     public:
+        explicit CollectionCursor(const ChebyshevCollection &cc) : m_cc(&cc) {};
 
-        /***
-        * @param coef The coefficients, the values of the function and its derivatives at the point x, c = {f(x), f'(x), f''(x), f'''(x)}
-        * @param x The point around which the expansion is based
+        /// Move the cursor to the expansion containing x and return its index; x must be within the domain of the collection
+        int locate(double x) {
+            m_index = m_cc->get_galloping_index(x, m_index);
+            return m_index;
+        }
+        /**
+         * \brief Obtain the value from the collection, moving the cursor
+         * Inputs outside the domain are handled by ChebyshevCollection::operator() and leave the cursor where it is
+         */
+        double operator()(double x) {
+            const auto &exps = m_cc->get_exps();
+            if (x < exps.front().xmin() || x > exps.back().xmax()) {
+                return (*m_cc)(x);
+            }
+            return exps[locate(x)].y_Clenshaw(x);
+        }
+        /// Obtain the values for an array of inputs in order, moving the cursor
+        Eigen::ArrayXd operator()(const Eigen::Ref<const Eigen::ArrayXd> &x) {
+            Eigen::ArrayXd y(x.size());
+            for (Eigen::Index j = 0; j < x.size(); ++j) { y(j) = (*this)(x(j)); }
+            return y;
+        }
+        /// The index of the expansion used for the last input, or -1 if there has not been one
+        int get_index() const { return m_index; }
+        /// Forget the position
+        void reset() { m_index = -1; }
+        /// The collection the cursor moves in
+        const ChebyshevCollection &get_collection() const { return *m_cc; }
+    };
+
+    /**
+    * @brief Generate a self-contained C source file that evaluates the collection
+    *
+    * The coefficients and domains are written into static arrays with enough digits to round-trip exactly, each
+    * distinct degree gets a fully unrolled Clenshaw evaluation, and the piece is located by the fastest method the
+    * breakpoints allow: a single multiply when the pieces are of equal width, a multiply and a table lookup when the
+    * breakpoints lie on a dyadic grid (as from dyadic_splitting) of at most 2^max_table_level cells, and otherwise a
+    * binary search.  The generated file defines
+    *
+    *     double <name>(double x);
+    *
+    * which returns NAN outside of [xmin, xmax].  The file is valid C99 and C++.
+    *
+    * @param cc The collection
+    * @param name The name of the function, which also prefixes the static arrays
+    * @param max_table_level The finest dyadic level for which a lookup table is generated
+    */
+    std::string generate_C_source(const ChebyshevCollection &cc, const std::string &name, int max_table_level = 12);
+
+    /**
+    * @brief A lookup table of piecewise Hermite interpolants on a uniform grid, made from a ChebyshevCollection
+    *
+    * The domain of the collection is divided into cells of equal width, and in each cell the collection is replaced by
+    * the cubic (or quintic) polynomial that matches its value and first (and second) derivatives at the ends of the cell.
+    * Locating the cell is a multiply and a truncation, and the evaluation is three (or five) fused multiply-adds with
+    * Horner's rule, so the table trades memory for latency relative to Clenshaw's method on the collection.
+    *
+    * The number of cells is chosen by the factory so that the difference from the collection, checked at three points
+    * in each cell, is within the tolerance given.
+    */
+    class HermiteTable {
+    private:
+        double m_xmin, m_xmax, m_inv_h;
+        int m_degree;
+        std::size_t m_Ncells;
+        std::vector<double> m_coef; ///< The m_degree+1 coefficients of the monomials in t in [0,1] for each cell, in increasing order
+        double m_verified_error;
+        HermiteTable(double xmin, double xmax, int degree, std::size_t Ncells, std::vector<double> &&coef, double verified_error)
+            : m_xmin(xmin), m_xmax(xmax), m_inv_h(static_cast<double>(Ncells)/(xmax - xmin)), m_degree(degree), m_Ncells(Ncells),
+            m_coef(std::move(coef)), m_verified_error(verified_error) {};
+    public:
+        /**
+        * @brief Build the table for a collection
+        *
+        * The number of cells starts from 64 and is increased from the observed rate of convergence, \f$O(h^{p+1})\f$ for degree
+        * \f$p\f$, until the largest difference from the collection at the quarter points of each cell is within tol.
+        *
+        * @param cc The collection
+        * @param degree Either 3 (values and first derivatives) or 5 (also second derivatives)
+        * @param tol The absolute tolerance on the difference from the collection
+        * @param max_cells Throw if more cells than this would be needed to satisfy the tolerance
         */
-        TaylorExtrapolator(const CoefType &coef, double x) : coef(coef), x0(x), degree(static_cast<int>(coef.size()-1)){}
+        static HermiteTable factory(const ChebyshevCollection &cc, int degree, double tol, std::size_t max_cells = std::size_t(1) << 24);
 
-        template<typename XType>
-        XType operator()(const XType &x) const {
-            auto factorial = [](auto x) { return tgamma(x + 1); };
-            auto dx = x - x0;
-            XType o = 0.0*x;
-            for (auto n = 0; n <= degree; ++n) {
-                o += coef[n] * pow(dx, n) / factorial(n);
+        /// Evaluate the table; throws if x is outside the domain
+        double operator()(double x) const {
+            if (!(x >= m_xmin && x <= m_xmax)) {
+                throw std::invalid_argument("Provided value of " + std::to_string(x) + " is outside the table range [" + std::to_string(m_xmin) + ", " + std::to_string(m_xmax) + "]");
             }
-            return o;
+            double t = (x - m_xmin)*m_inv_h;
+            const std::size_t i = std::min(static_cast<std::size_t>(t), m_Ncells - 1);
+            t -= static_cast<double>(i);
+            const double *a = m_coef.data() + i*static_cast<std::size_t>(m_degree + 1);
+            if (m_degree == 3) {
+                return ((a[3]*t + a[2])*t + a[1])*t + a[0];
+            }
+            return ((((a[5]*t + a[4])*t + a[3])*t + a[2])*t + a[1])*t + a[0];
         }
+        /// Evaluate the table for an array of inputs; throws if any is outside the domain
+        Eigen::ArrayXd operator()(const Eigen::Ref<const Eigen::ArrayXd> &x) const;
 
-        auto get_coef(){
-            return coef;
-        }
+        double xmin() const { return m_xmin; }
+        double xmax() const { return m_xmax; }
+        /// The degree of the polynomial in each cell, 3 or 5
+        int get_degree() const { return m_degree; }
+        /// The number of cells of the grid
+        std::size_t get_Ncells() const { return m_Ncells; }
+        /// The largest difference from the collection found at the check points when the table was built
+        double get_verified_error() const { return m_verified_error; }
+        /// The memory used by the coefficients, in bytes
+        std::size_t get_memory_bytes() const { return m_coef.size()*sizeof(double); }
+    };
+
+    /**
+    * @brief Least-squares fit of a ChebyshevExpansion of fixed degree to a stream of samples
+    *
+    * The upper-triangular factor \f$\mathbf{R}\f$ of the QR factorization of the matrix of Chebyshev polynomials evaluated
+    * at the samples, and the rotated right-hand side, are updated with Givens rotations as each sample arrives, in
+    * \f$O(N^2)\f$ operations and without storing the samples.  Older samples can be down-weighted exponentially by a
+    * forgetting factor.  The expansion is obtained on demand by back substitution, also in \f$O(N^2)\f$ operations.
+    */
+    class OnlineChebyshevFitter {
+    private:
+        std::size_t m_N; ///< The degree of the expansion
+        double m_xmin, m_xmax; ///< The domain of the expansion
+        double m_forgetting; ///< Each existing sample is down-weighted by this factor when a new sample is added
+        Eigen::MatrixXd m_R; ///< Upper-triangular factor
+        Eigen::VectorXd m_z; ///< Rotated right-hand side
+        Eigen::VectorXd m_row; ///< Scratch space for the row of the new sample
+        std::size_t m_Nsamples = 0;
+    public:
+        /**
+        * @param N The degree of the expansion
+        * @param xmin The minimum value of x for the expansion
+        * @param xmax The maximum value of x for the expansion
+        * @param forgetting The factor in (0, 1] by which the weight of all previous samples is multiplied when a sample is added; 1 keeps all history
+        */
+        OnlineChebyshevFitter(std::size_t N, double xmin, double xmax, double forgetting = 1.0);
+        /// Absorb one sample, with an optional weight
+        void add_sample(double x, double y, double weight = 1.0);
+        /// Absorb a set of samples, in order
+        void add_samples(const Eigen::VectorXd &x, const Eigen::VectorXd &y);
+        /// Forget all the samples
+        void reset();
+        /// The number of samples that have been absorbed
+        std::size_t get_Nsamples() const { return m_Nsamples; }
+        /// Get the least-squares expansion for the samples so far; throws if the samples do not determine it
+        ChebyshevExpansion get_expansion() const;
+    };
+
+    /**
+    * @brief A multivariate Chebyshev expansion in tensor-train form
+    *
+    * The coefficient tensor \f$c_{j_1\cdots j_d}\f$ of the tensor product of Chebyshev polynomials is held as a train of
+    * cores, \f$c_{j_1\cdots j_d} = G_1[j_1]G_2[j_2]\cdots G_d[j_d]\f$, where \f$G_k[j]\f$ is an \f$r_{k-1}\times r_k\f$
+    * matrix and \f$r_0=r_d=1\f$.  The storage is \f$O(d N r^2)\f$ rather than the \f$N^d\f$ of the dense tensor.
+    *
+    * A point is evaluated one mode at a time: Clenshaw's recurrence is carried out for each core with matrix-valued
+    * coefficients, which gives \f$G_k(x_k)=\sum_j G_k[j]T_j(x_k)\f$, and the row vector of the modes so far is multiplied by it.
+    */
+    class ChebyshevTensorTrain {
+    public:
+        using Function = std::function<double(const Eigen::Ref<const Eigen::VectorXd> &)>;
+    private:
+        std::vector<Eigen::MatrixXd> m_cores; ///< Core k as an \f$(r_{k-1}r_k)\times(N_k+1)\f$ matrix; column j is \f$G_k[j]\f$ in column-major order
+        std::vector<Eigen::Index> m_ranks; ///< The ranks \f$r_0,\ldots,r_d\f$
+        Eigen::ArrayXd m_xmin, m_xmax; ///< The domain of each variable
+        double m_estimated_error = 0; ///< The largest error found at the validation points of the construction
+    public:
+        /**
+        * @param cores The cores; core k has \f$r_{k-1}r_k\f$ rows and one column per coefficient
+        * @param ranks The ranks \f$r_0,\ldots,r_d\f$, with \f$r_0=r_d=1\f$
+        * @param xmin The minimum of each variable
+        * @param xmax The maximum of each variable
+        */
+        ChebyshevTensorTrain(const std::vector<Eigen::MatrixXd> &cores, const std::vector<Eigen::Index> &ranks, const Eigen::ArrayXd &xmin, const Eigen::ArrayXd &xmax);
+
+        /**
+        * @brief Build the expansion of a function of d variables by tensor-train cross approximation
+        * @param degrees The degree in each variable
+        * @param func The function, taking the vector of the d variables
+        * @param xmin The minimum of each variable
+        * @param xmax The maximum of each variable
+        * @param tol The relative tolerance, for the error at the validation points and for the rounding of the ranks
+        * @param max_rank The largest rank that is tried
+        *
+        * The function is sampled only at fibres of the tensor grid of Chebyshev-Lobatto nodes chosen by the maxvol
+        * principle, in alternating sweeps (Oseledets and Tyrtyshnikov, Linear Algebra Appl., 2010).  The ranks are
+        * doubled from 2 until the error at a set of random validation points is within tolerance.  The values on the
+        * grid are then taken to coefficients mode by mode, and the ranks are reduced by TT-rounding.
+        */
+        static ChebyshevTensorTrain factory(const std::vector<std::size_t> &degrees, const Function &func,
+            const Eigen::ArrayXd &xmin, const Eigen::ArrayXd &xmax, double tol = 1e-12, Eigen::Index max_rank = 32);
 
+        /// The number of variables
+        std::size_t dim() const { return m_cores.size(); }
+        /// The ranks \f$r_0,\ldots,r_d\f$
+        const std::vector<Eigen::Index> &ranks() const { return m_ranks; }
+        /// The degree in each variable
+        std::vector<std::size_t> degrees() const;
+        /// The cores, as described for the constructor
+        const std::vector<Eigen::MatrixXd> &cores() const { return m_cores; }
+        /// The number of coefficients stored in the cores
+        Eigen::Index storage_size() const;
+        /// The largest absolute error found at the validation points when built by factory; zero otherwise
+        double estimated_error() const { return m_estimated_error; }
+        /// The minimum of each variable
+        const Eigen::ArrayXd &xmin() const { return m_xmin; }
+        /// The maximum of each variable
+        const Eigen::ArrayXd &xmax() const { return m_xmax; }
 
+        /// Evaluate at one point of d variables
+        double y(const Eigen::Ref<const Eigen::VectorXd> &x) const;
+        /**
+        * @brief Evaluate at a cloud of points
+        * @param X The points, one per row, with d columns
+        * @param Nthreads The number of threads over which blocks of points are shared
+        */
+        Eigen::ArrayXd y_batch(const Eigen::Ref<const Eigen::ArrayXXd> &X, int Nthreads = 1) const;
+        /// The number of points that are evaluated together in y_batch
+        static constexpr Eigen::Index batch_block_size = 64;
+
+        /// Reduce the ranks with TT-rounding, to a relative Frobenius-norm tolerance of the coefficient tensor
+        void round(double tol);
     };
 
-    /// A factory function to make a Taylor extrapolator from a Chebyshev expansion of given degree around the position x
-    static auto make_Taylor_extrapolator(const ChebyshevExpansion &ce, double x, int degree) {
-        Eigen::ArrayXd c(degree + 1);
-        for (auto n = 0; n <= degree; ++n) {
-            c[n] = ce.deriv(n).y(x);
-        }
-        return TaylorExtrapolator<decltype(c)>(c, x);
+    /**
+    * @brief Banded operators of the ultraspherical spectral method of Olver and Townsend
+    *
+    * Coefficients in the Chebyshev basis \f$T_n\f$ are denoted as the \f$\lambda=0\f$ basis, and coefficients in the
+    * ultraspherical basis \f$C^{(\lambda)}_n\f$ as the \f$\lambda\f$ basis.  All operators are square with \f$n\f$ rows
+    * and act on the coefficients of polynomials on [-1,1].
+    */
+    namespace ultraspherical {
+        using SparseMatrix = Eigen::SparseMatrix<double>;
+        /// The operator taking coefficients in the \f$T\f$ basis to the coefficients of the k-th derivative in the \f$C^{(k)}\f$ basis; bandwidth 1
+        SparseMatrix differentiation(Eigen::Index n, int k);
+        /// The operator converting coefficients in the \f$\lambda\f$ basis to the \f$\lambda+1\f$ basis; bandwidth 3
+        SparseMatrix conversion(Eigen::Index n, int lambda);
+        /// The operator multiplying by a in the \f$\lambda\f$ basis, with bandwidth 2m+1 for an expansion a of degree m
+        SparseMatrix multiplication(const ChebyshevExpansion &a, Eigen::Index n, int lambda);
     }
 
+    /// The boundary condition \f$\sum_d w_d u^{(d)}(x) = {\rm value}\f$ of a boundary value problem
+    struct BoundaryCondition {
+        double x; ///< The location of the condition, usually an end of the domain
+        std::vector<double> weights; ///< The weights of the derivatives of order 0, 1, ...
+        double value; ///< The right-hand side
+    };
+
+    /**
+    * @brief Solve the linear boundary value problem \f$\sum_{k=0}^K a_k(x) u^{(k)}(x) = f(x)\f$ with the ultraspherical spectral method
+    *
+    * The operator is assembled from banded differentiation, conversion and multiplication operators, so the \f$N+1-K\f$
+    * rows of the discretized equation are banded, and the \f$K\f$ boundary conditions occupy the other rows.  The banded
+    * block of highest-derivative columns is factored with Givens rotations and the boundary rows are eliminated through
+    * a \f$K\times K\f$ capacitance matrix, for a cost linear in N.
+    *
+    * @param a The coefficients \f$a_0, a_1, \ldots, a_K\f$ of the equation, on the same domain as f
+    * @param f The right-hand side
+    * @param bcs The K boundary conditions
+    * @param N The degree of the solution
+    */
+    ChebyshevExpansion solve_linear_BVP(const std::vector<ChebyshevExpansion> &a, const ChebyshevExpansion &f, const std::vector<BoundaryCondition> &bcs, std::size_t N);
+
 }; /* namespace ChebTools */
 #endif
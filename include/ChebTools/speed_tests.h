@@ -10,5 +10,12 @@ double mult_by_inplace(ChebTools::ChebyshevExpansion &ce, double val, int N);
 void mult_by(ChebTools::ChebyshevExpansion &ce, double val, int N);
 std::map<std::string, double> evaluation_speed_test(ChebTools::ChebyshevExpansion &cee, const Eigen::VectorXd &xpts, long N) ;
 Eigen::MatrixXd eigs_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrepeats);
+Eigen::MatrixXd real_roots_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrepeats);
+std::map<std::string, double> warmup_latency_test(std::size_t N, std::size_t Nrepeats);
+Eigen::MatrixXd minimize_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrepeats);
+std::map<std::string, double> Hermite_table_speed_test(double tol, std::size_t Npoints);
+std::map<std::string, double> cursor_speed_test(std::size_t Npieces, std::size_t Npoints);
+std::map<std::string, double> splitting_cost_test(std::size_t N, double tol);
+std::map<std::string, double> pencil_speed_test(std::size_t N, std::size_t Nshifts);
 
 #endif
\ No newline at end of file
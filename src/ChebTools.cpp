@@ -8,7 +8,20 @@
 #include <chrono>
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <atomic>
+#include <exception>
 #include <limits>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <memory>
+#include <utility>
+#include <thread>
 
 #ifndef DBL_EPSILON
 #define DBL_EPSILON std::numeric_limits<double>::epsilon()
@@ -40,6 +53,42 @@ double binomialCoefficient(const double n, const double k) {
 
 namespace ChebTools {
 
+    /**
+    * @brief Run body(i) for each i in [0, N) on up to Nthreads threads, or on all the hardware threads if Nthreads <= 0
+    *
+    * The calling thread takes part, and the indices are handed out one at a time.  The first exception thrown by body
+    * stops the handing out of indices and is rethrown in the calling thread once all the threads have finished.
+    */
+    template<typename Body>
+    static void parallel_for(long N, int Nthreads, const Body &body) {
+        long Nworkers = (Nthreads > 0) ? Nthreads : static_cast<long>(std::max(1u, std::thread::hardware_concurrency()));
+        Nworkers = std::min(Nworkers, N);
+        if (Nworkers <= 1) {
+            for (long i = 0; i < N; ++i) { body(i); }
+            return;
+        }
+        std::atomic<long> next(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto work = [&]() {
+            for (long i = next++; i < N; i = next++) {
+                try {
+                    body(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(error_mutex);
+                    if (!error) { error = std::current_exception(); }
+                    next = N;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (long t = 1; t < Nworkers; ++t) { threads.emplace_back(work); }
+        work();
+        for (auto &thread : threads) { thread.join(); }
+        if (error) { std::rethrow_exception(error); }
+    }
+
     inline bool ValidNumber(double x){
         // Idea from http://www.johndcook.com/IEEE_exceptions_in_cpp.html
         return (x <= DBL_MAX && x >= -DBL_MAX);
@@ -88,31 +137,154 @@ namespace ChebTools {
         } while (!converged);
     }
 
+    void balance_colleague(Eigen::VectorXd &lower, Eigen::VectorXd &upper, Eigen::VectorXd &lastrow, Eigen::VectorXd &D) {
+        // Algorithm #3 of https://arxiv.org/pdf/1401.5766.pdf, as in balance_matrix, but the row and column norms
+        // are obtained from the O(1) nonzero entries of each row and column, except for the last row, whose norm is
+        // kept up to date as its entries are scaled
+        const Eigen::Index N = lastrow.size();
+        const double beta = 2;
+        D = Eigen::VectorXd::Ones(N);
+        int iter = 0;
+        bool converged = false;
+        do {
+            converged = true;
+            double lastrow_sq = lastrow.squaredNorm();
+            for (Eigen::Index i = 0; i < N; ++i) {
+                double csq = POW2(lastrow(i)), rsq;
+                if (i >= 1) { csq += POW2(upper(i - 1)); }
+                if (i + 2 < N) { csq += POW2(lower(i)); }
+                if (i == N - 1) {
+                    rsq = lastrow_sq;
+                }
+                else {
+                    rsq = POW2(upper(i));
+                    if (i >= 1) { rsq += POW2(lower(i - 1)); }
+                }
+                double c = sqrt(csq), r = sqrt(rsq);
+                if (c == 0 || r == 0) { continue; }
+                double s = csq + rsq, f = 1;
+                while (c < r/beta) {
+                    c *= beta;
+                    r /= beta;
+                    f *= beta;
+                }
+                while (c >= r*beta) {
+                    c /= beta;
+                    r *= beta;
+                    f /= beta;
+                }
+                if (c*c + r*r < 0.95*s) {
+                    converged = false;
+                    D(i) *= f;
+                    // Column i is multiplied by f and row i is divided by f
+                    if (i >= 1) { upper(i - 1) *= f; }
+                    if (i + 2 < N) { lower(i) *= f; }
+                    if (i == N - 1) {
+                        lastrow.head(N - 1) /= f;
+                        lastrow_sq = lastrow.squaredNorm();
+                    }
+                    else {
+                        lastrow_sq += POW2(lastrow(i))*(f*f - 1);
+                        lastrow(i) *= f;
+                        upper(i) /= f;
+                        if (i >= 1) { lower(i - 1) /= f; }
+                    }
+                }
+            }
+            iter++;
+            if (iter > 50) {
+                break;
+            }
+        } while (!converged);
+    }
+
     /**
-    * @brief A library that stores the Chebyshev-Lobatto nodes in the domain [-1,1]
-    * @note The Chebyshev-Lobatto nodes are a function of degree, but not of the coefficients
+    * @brief A thread-safe cache of objects that are a function only of the degree of the expansion
+    *
+    * Degrees up to max_fixed_degree live in fixed slots, each built once under std::call_once, after which the
+    * lookup takes no lock and no search.  Larger degrees are held in a std::map; references into a std::map
+    * stay valid, so only the lookup and insertion need to be locked.
     */
-    class ChebyshevLobattoNodesLibrary {
+    template<typename T>
+    class DegreeLibrary {
+    public:
+        using Builder = T(*)(std::size_t);
     private:
-        std::map<std::size_t, Eigen::VectorXd> vectors;
-        void build(std::size_t N) {
-            double NN = static_cast<double>(N); // just a cast
-            vectors[N] = (Eigen::VectorXd::LinSpaced(N + 1, 0, NN).array()*EIGEN_PI / N).cos();
+        Builder build;
+        std::array<std::once_flag, max_fixed_degree + 1> flags;
+        std::array<T, max_fixed_degree + 1> fixed;
+        std::array<std::atomic<bool>, max_fixed_degree + 1> built{};
+        std::map<std::size_t, T> values;
+        std::mutex mutex;
+        static bool is_fixed(std::size_t N) { return N >= 1 && N <= max_fixed_degree; }
+        void set_fixed(std::size_t N, T &&value) {
+            std::call_once(flags[N], [&]() { fixed[N] = std::move(value); built[N] = true; });
         }
     public:
-        /// Get the Chebyshev-Lobatto nodes for expansion of degree \f$N\f$
-        const Eigen::VectorXd & get(std::size_t N) {
-            auto it = vectors.find(N);
-            if (it != vectors.end()) {
-                return it->second;
+        explicit DegreeLibrary(Builder build) : build(build) {};
+        /// Get the object of degree N, building it if it is not yet in the cache
+        const T & get(std::size_t N) {
+            if (is_fixed(N)) {
+                if (!built[N]) { set_fixed(N, build(N)); }
+                return fixed[N];
             }
-            else {
-                build(N);
-                return vectors.find(N)->second;
+            std::lock_guard<std::mutex> guard(mutex);
+            auto it = values.find(N);
+            if (it == values.end()) {
+                it = values.emplace(N, build(N)).first;
+            }
+            return it->second;
+        }
+        /// Put an object of degree N into the cache; an object already there is kept, so references to it stay valid
+        void put(std::size_t N, T &&value) {
+            if (is_fixed(N)) { set_fixed(N, std::move(value)); return; }
+            std::lock_guard<std::mutex> guard(mutex);
+            values.emplace(N, std::move(value));
+        }
+        /// The degrees currently in the cache, in increasing order; degree 0 has no nodes, so it is never listed
+        std::vector<std::size_t> degrees() {
+            std::vector<std::size_t> o;
+            for (std::size_t N = 1; N <= max_fixed_degree; ++N) {
+                if (built[N]) { o.push_back(N); }
+            }
+            std::lock_guard<std::mutex> guard(mutex);
+            for (const auto &kv : values) {
+                if (kv.first > max_fixed_degree) { o.push_back(kv.first); }
             }
+            return o;
         }
     };
-    static ChebyshevLobattoNodesLibrary CLnodes_library;
+
+    /// Copies of the compile-time tables of degree N into dynamically sized Eigen types, for the libraries
+    struct FixedNodes { template<std::size_t N> static Eigen::VectorXd get() { return ChebyshevLobattoTables<N>::nodes_map(); } };
+    struct FixedLMatrix { template<std::size_t N> static Eigen::MatrixXd get() { return ChebyshevLobattoTables<N>::L_map(); } };
+    struct FixedUMatrix { template<std::size_t N> static Eigen::MatrixXd get() { return ChebyshevLobattoTables<N>::U_map(); } };
+
+    /// Getter::get<N>() for a runtime degree N in [1, max_fixed_degree], through a table of the instantiations for each degree
+    template<typename Getter, std::size_t... I>
+    static auto from_fixed_tables(std::size_t N, std::index_sequence<I...>) {
+        using Result = decltype(Getter::template get<1>());
+        static constexpr Result (*table[])() = { &Getter::template get<I + 1>... };
+        return table[N - 1]();
+    }
+    template<typename Getter>
+    static auto from_fixed_tables(std::size_t N) {
+        return from_fixed_tables<Getter>(N, std::make_index_sequence<max_fixed_degree>{});
+    }
+
+    /**
+    * @brief Build the Chebyshev-Lobatto nodes in the domain [-1,1] of degree N
+    * @note The Chebyshev-Lobatto nodes are a function of degree, but not of the coefficients.  Up to max_fixed_degree
+    * they are the values of ChebyshevLobattoTables<N>.
+    */
+    static Eigen::VectorXd build_CLnodes(std::size_t N) {
+        if (N >= 1 && N <= max_fixed_degree) {
+            return from_fixed_tables<FixedNodes>(N);
+        }
+        double NN = static_cast<double>(N); // just a cast
+        return (Eigen::VectorXd::LinSpaced(N + 1, 0, NN).array()*EIGEN_PI / N).cos();
+    }
+    static DegreeLibrary<Eigen::VectorXd> CLnodes_library(build_CLnodes);
     const Eigen::VectorXd &get_CLnodes(std::size_t N){
         return CLnodes_library.get(N);
     }
@@ -140,159 +312,254 @@ namespace ChebTools {
     //static ChebyshevRootsLibrary roots_library;
 
     /**
-    * @brief This class stores sets of L matrices (because they are a function only of the degree of the expansion)
+    * @brief Build the L matrix of degree N
     *
     * The L matrix is used to convert from functional values to coefficients, as in \f[ \vec{c} = \mathbf{L}\vec{f} \f]
     */
-    class LMatrixLibrary {
-    private:
-        std::map<std::size_t, Eigen::MatrixXd> matrices;
-        void build(std::size_t N) {
-            Eigen::MatrixXd L(N + 1, N + 1); ///< Matrix of coefficients
-            for (int j = 0; j <= N; ++j) {
-                for (int k = j; k <= N; ++k) {
-                    double p_j = (j == 0 || j == N) ? 2 : 1;
-                    double p_k = (k == 0 || k == N) ? 2 : 1;
-                    L(j, k) = 2.0 / (p_j*p_k*N)*cos((j*EIGEN_PI*k) / N);
-                    // Exploit symmetry to fill in the symmetric elements in the matrix
-                    L(k, j) = L(j, k);
-                }
+    static Eigen::MatrixXd build_L_matrix(std::size_t N) {
+        if (N >= 1 && N <= max_fixed_degree) {
+            return from_fixed_tables<FixedLMatrix>(N);
+        }
+        Eigen::MatrixXd L(N + 1, N + 1); ///< Matrix of coefficients
+        for (int j = 0; j <= N; ++j) {
+            for (int k = j; k <= N; ++k) {
+                double p_j = (j == 0 || j == N) ? 2 : 1;
+                double p_k = (k == 0 || k == N) ? 2 : 1;
+                L(j, k) = 2.0 / (p_j*p_k*N)*cos((j*EIGEN_PI*k) / N);
+                // Exploit symmetry to fill in the symmetric elements in the matrix
+                L(k, j) = L(j, k);
             }
-            matrices[N] = L;
         }
-    public:
-        /// Get the \f$\mathbf{L}\f$ matrix of degree N
-        const Eigen::MatrixXd & get(std::size_t N) {
-            auto it = matrices.find(N);
-            if (it != matrices.end()) {
-                return it->second;
+        return L;
+    }
+    /// The L matrices, stored because they are a function only of the degree of the expansion
+    static DegreeLibrary<Eigen::MatrixXd> l_matrix_library(build_L_matrix);
+
+    /**
+    * @brief Build the U matrix of degree N
+    *
+    * The U matrix is used to convert from coefficients to functional values, as in \f[ \vec{f} = \mathbf{U}\vec{c} \f]
+    */
+    static Eigen::MatrixXd build_U_matrix(std::size_t N) {
+        if (N >= 1 && N <= max_fixed_degree) {
+            return from_fixed_tables<FixedUMatrix>(N);
+        }
+        Eigen::MatrixXd U(N + 1, N + 1); ///< Matrix of coefficients
+        for (int j = 0; j <= N; ++j) {
+            for (int k = j; k <= N; ++k) {
+                U(j, k) = cos((j*EIGEN_PI*k) / N);
+                // Exploit symmetry to fill in the symmetric elements in the matrix
+                U(k, j) = U(j, k);
             }
-            else {
-                build(N);
-                return matrices.find(N)->second;
+        }
+        return U;
+    }
+    /// The U matrices, stored because they are a function only of the degree of the expansion
+    static DegreeLibrary<Eigen::MatrixXd> u_matrix_library(build_U_matrix);
+
+    void warmup(const std::vector<std::size_t> &degrees) {
+        for (auto N : degrees) {
+            if (N < 1) { throw std::invalid_argument("Degrees to warm up must be at least 1"); }
+            CLnodes_library.get(N);
+            l_matrix_library.get(N);
+            u_matrix_library.get(N);
+        }
+    }
+
+    std::vector<std::size_t> cached_degrees() {
+        std::vector<std::size_t> o;
+        for (auto &&degs : { CLnodes_library.degrees(), l_matrix_library.degrees(), u_matrix_library.degrees() }) {
+            o.insert(o.end(), degs.begin(), degs.end());
+        }
+        std::sort(o.begin(), o.end());
+        o.erase(std::unique(o.begin(), o.end()), o.end());
+        return o;
+    }
+
+    static const char transform_cache_magic[8] = { 'C','H','E','B','T','C','0','1' };
+
+    void save_transform_cache(const std::string &path) {
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs) { throw std::invalid_argument("Unable to open " + path + " for writing"); }
+        auto degrees = cached_degrees();
+        ofs.write(transform_cache_magic, sizeof(transform_cache_magic));
+        std::uint64_t count = degrees.size();
+        ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (auto N : degrees) {
+            std::uint64_t N64 = N;
+            ofs.write(reinterpret_cast<const char*>(&N64), sizeof(N64));
+            const Eigen::VectorXd &x = CLnodes_library.get(N);
+            const Eigen::MatrixXd &L = l_matrix_library.get(N), &U = u_matrix_library.get(N);
+            ofs.write(reinterpret_cast<const char*>(x.data()), x.size()*sizeof(double));
+            ofs.write(reinterpret_cast<const char*>(L.data()), L.size()*sizeof(double));
+            ofs.write(reinterpret_cast<const char*>(U.data()), U.size()*sizeof(double));
+        }
+        if (!ofs) { throw std::invalid_argument("Unable to write the transform cache to " + path); }
+    }
+
+    std::size_t load_transform_cache(const std::string &path) {
+        // The whole file is read in one go and the records are copied out of the buffer
+        std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+        if (!ifs) { throw std::invalid_argument("Unable to open " + path + " for reading"); }
+        std::vector<char> buf(static_cast<std::size_t>(ifs.tellg()));
+        ifs.seekg(0);
+        ifs.read(buf.data(), buf.size());
+        std::size_t pos = 0;
+        auto take = [&](void *dest, std::size_t nbytes) {
+            if (nbytes > buf.size() - pos) { throw std::invalid_argument("Transform cache file " + path + " is truncated"); }
+            std::memcpy(dest, buf.data() + pos, nbytes);
+            pos += nbytes;
+        };
+        char magic[sizeof(transform_cache_magic)];
+        take(magic, sizeof(magic));
+        if (!std::equal(magic, magic + sizeof(magic), transform_cache_magic)) {
+            throw std::invalid_argument(path + " is not a ChebTools transform cache file");
+        }
+        std::uint64_t count;
+        take(&count, sizeof(count));
+        for (std::uint64_t i = 0; i < count; ++i) {
+            std::uint64_t N64;
+            take(&N64, sizeof(N64));
+            if (N64 < 1) {
+                throw std::invalid_argument("Invalid degree in transform cache file " + path);
             }
+            // A record of degree N holds (N+1)(2N+3) doubles, which must all be in the file before anything is allocated;
+            // N < ndoubles keeps 2N+3 from overflowing, and the division keeps the product from overflowing
+            const std::uint64_t ndoubles = (buf.size() - pos)/sizeof(double);
+            if (N64 >= ndoubles || N64 + 1 > ndoubles/(2*N64 + 3)) {
+                throw std::invalid_argument("Transform cache file " + path + " is truncated");
+            }
+            const auto N = static_cast<Eigen::Index>(N64);
+            Eigen::VectorXd x(N + 1);
+            Eigen::MatrixXd L(N + 1, N + 1), U(N + 1, N + 1);
+            take(x.data(), x.size()*sizeof(double));
+            take(L.data(), L.size()*sizeof(double));
+            take(U.data(), U.size()*sizeof(double));
+            CLnodes_library.put(N64, std::move(x));
+            l_matrix_library.put(N64, std::move(L));
+            u_matrix_library.put(N64, std::move(U));
         }
-    };
-    static LMatrixLibrary l_matrix_library;
+        return static_cast<std::size_t>(count);
+    }
 
     /**
-    * @brief This class stores sets of U matrices (because they are a function only of the degree of the expansion)
+    * @brief This class stores the matrices that take values at the Chebyshev-Lobatto nodes of degree Nold to those of degree Nnew
     *
-    * The U matrix is used to convert from coefficients to functional values, as in \f[ \vec{f} = \mathbf{U}\vec{c} \f]
+    * The nodal values are transformed to coefficients (DCT), the coefficients are zero-padded or truncated to
+    * the new degree, and transformed back to nodal values, so the matrix is \f[ \mathbf{U}_{N_{new}}\mathbf{P}\mathbf{L}_{N_{old}} \f]
     */
-    class UMatrixLibrary {
+    class ResamplingMatrixLibrary {
     private:
-        std::map<std::size_t, Eigen::MatrixXd> matrices;
-        void build(std::size_t N) {
-            Eigen::MatrixXd U(N + 1, N + 1); ///< Matrix of coefficients
-            for (int j = 0; j <= N; ++j) {
-                for (int k = j; k <= N; ++k) {
-                    U(j, k) = cos((j*EIGEN_PI*k) / N);
-                    // Exploit symmetry to fill in the symmetric elements in the matrix
-                    U(k, j) = U(j, k);
-                }
-            }
-            matrices[N] = U;
+        std::map<std::pair<std::size_t, std::size_t>, Eigen::MatrixXd> matrices;
+        std::mutex mutex; ///< References into a std::map stay valid, so only the lookup and insertion need to be locked
+        void build(std::size_t Nold, std::size_t Nnew) {
+            const Eigen::Index Nkeep = static_cast<Eigen::Index>(std::min(Nold, Nnew)) + 1;
+            const Eigen::MatrixXd &L = l_matrix_library.get(Nold), &U = u_matrix_library.get(Nnew);
+            matrices[std::make_pair(Nold, Nnew)] = U.leftCols(Nkeep)*L.topRows(Nkeep);
         }
     public:
-        /// Get the \f$\mathbf{U}\f$ matrix of degree N
-        const Eigen::MatrixXd & get(std::size_t N) {
-            auto it = matrices.find(N);
+        /// Get the resampling matrix from degree Nold to degree Nnew
+        const Eigen::MatrixXd & get(std::size_t Nold, std::size_t Nnew) {
+            std::lock_guard<std::mutex> guard(mutex);
+            auto key = std::make_pair(Nold, Nnew);
+            auto it = matrices.find(key);
             if (it != matrices.end()) {
                 return it->second;
             }
             else {
-                build(N);
-                return matrices.find(N)->second;
+                build(Nold, Nnew);
+                return matrices.find(key)->second;
             }
         }
     };
-    static UMatrixLibrary u_matrix_library;
+    static ResamplingMatrixLibrary resampling_matrix_library;
 
     // From CoolProp
     template<class T> bool is_in_closed_range(T x1, T x2, T x) { return (x >= std::min(x1, x2) && x <= std::max(x1, x2)); };
 
     ChebyshevExpansion ChebyshevExpansion::operator+(const ChebyshevExpansion &ce2) const {
-        if (m_c.size() == ce2.coef().size()) {
+        if (m_c.size() == ce2.coef_view().size()) {
             // Both are the same size, nothing creative to do, just add the coefficients
-            return ChebyshevExpansion(std::move(ce2.coef() + m_c), m_xmin, m_xmax);
+            return ChebyshevExpansion(ce2.coef_view() + m_c.map(), m_xmin, m_xmax);
         }
         else{
-            if (m_c.size() > ce2.coef().size()) {
-                Eigen::VectorXd c(m_c.size()); c.setZero(); c.head(ce2.coef().size()) = ce2.coef();
-                return ChebyshevExpansion(c+m_c, m_xmin, m_xmax);
+            if (m_c.size() > ce2.coef_view().size()) {
+                Eigen::VectorXd c(m_c.size()); c.setZero(); c.head(ce2.coef_view().size()) = ce2.coef_view();
+                return ChebyshevExpansion(c+m_c.map(), m_xmin, m_xmax);
             }
             else {
-                std::size_t n = ce2.coef().size();
-                Eigen::VectorXd c(n); c.setZero(); c.head(m_c.size()) = m_c;
-                return ChebyshevExpansion(c + ce2.coef(), m_xmin, m_xmax);
+                std::size_t n = ce2.coef_view().size();
+                Eigen::VectorXd c(n); c.setZero(); c.head(m_c.size()) = m_c.map();
+                return ChebyshevExpansion(c + ce2.coef_view(), m_xmin, m_xmax);
             }
         }
     };
     ChebyshevExpansion& ChebyshevExpansion::operator+=(const ChebyshevExpansion &donor) {
-        std::size_t Ndonor = donor.coef().size(), N1 = m_c.size();
+        const auto dc = donor.coef_view();
+        std::size_t Ndonor = dc.size(), N1 = m_c.size();
         std::size_t Nmin = std::min(N1, Ndonor), Nmax = std::max(N1, Ndonor);
         // The first Nmin terms overlap between the two vectors
-        m_c.head(Nmin) += donor.coef().head(Nmin);
+        m_c.map().head(Nmin) += dc.head(Nmin);
         // If the donor vector is longer than the current vector, resizing is needed
         if (Ndonor > N1) {
             // Resize but leave values as they were
             m_c.conservativeResize(Ndonor);
             // Copy the last Nmax-Nmin values from the donor
-            m_c.tail(Nmax - Nmin) = donor.coef().tail(Nmax - Nmin);
+            m_c.map().tail(Nmax - Nmin) = dc.tail(Nmax - Nmin);
         }
         return *this;
     }
     ChebyshevExpansion& ChebyshevExpansion::operator-=(const ChebyshevExpansion& donor) {
-        std::size_t Ndonor = donor.coef().size(), N1 = m_c.size();
+        const auto dc = donor.coef_view();
+        std::size_t Ndonor = dc.size(), N1 = m_c.size();
         std::size_t Nmin = std::min(N1, Ndonor), Nmax = std::max(N1, Ndonor);
         // The first Nmin terms overlap between the two vectors
-        m_c.head(Nmin) -= donor.coef().head(Nmin);
+        m_c.map().head(Nmin) -= dc.head(Nmin);
         // If the donor vector is longer than the current vector, resizing is needed
         if (Ndonor > N1) {
             // Resize but leave values as they were
             m_c.conservativeResize(Ndonor);
             // Copy the last Nmax-Nmin values from the donor
-            m_c.tail(Nmax - Nmin) = -donor.coef().tail(Nmax - Nmin);
+            m_c.map().tail(Nmax - Nmin) = -dc.tail(Nmax - Nmin);
         }
         return *this;
     }
     ChebyshevExpansion ChebyshevExpansion::operator-(const ChebyshevExpansion& ce2) const {
-        if (m_c.size() == ce2.coef().size()) {
+        if (m_c.size() == ce2.coef_view().size()) {
             // Both are the same size, nothing creative to do, just subtract the coefficients
-            return ChebyshevExpansion(std::move(ce2.coef() - m_c), m_xmin, m_xmax);
+            return ChebyshevExpansion(m_c.map() - ce2.coef_view(), m_xmin, m_xmax);
         }
         else {
-            if (m_c.size() > ce2.coef().size()) {
-                Eigen::VectorXd c(m_c.size()); c.setZero(); c.head(ce2.coef().size()) = ce2.coef();
-                return ChebyshevExpansion(m_c - c, m_xmin, m_xmax);
+            if (m_c.size() > ce2.coef_view().size()) {
+                Eigen::VectorXd c(m_c.size()); c.setZero(); c.head(ce2.coef_view().size()) = ce2.coef_view();
+                return ChebyshevExpansion(m_c.map() - c, m_xmin, m_xmax);
             }
             else {
-                std::size_t n = ce2.coef().size();
-                Eigen::VectorXd c(n); c.setZero(); c.head(m_c.size()) = m_c;
-                return ChebyshevExpansion(c - ce2.coef(), m_xmin, m_xmax);
+                std::size_t n = ce2.coef_view().size();
+                Eigen::VectorXd c(n); c.setZero(); c.head(m_c.size()) = m_c.map();
+                return ChebyshevExpansion(c - ce2.coef_view(), m_xmin, m_xmax);
             }
         }
     };
     ChebyshevExpansion ChebyshevExpansion::operator*(double value) const {
-        return ChebyshevExpansion(m_c*value, m_xmin, m_xmax);
+        return ChebyshevExpansion(m_c.map()*value, m_xmin, m_xmax);
     }
     ChebyshevExpansion ChebyshevExpansion::operator+(double value) const {
-        Eigen::VectorXd c = m_c;
-        c(0) += value;
-        return ChebyshevExpansion(c, m_xmin, m_xmax);
+        // Built from the coefficients, so that cached nodal values of this expansion are not carried over
+        ChebyshevExpansion ce(m_c.map(), m_xmin, m_xmax);
+        ce.m_c(0) += value;
+        return ce;
     }
     ChebyshevExpansion ChebyshevExpansion::operator-(double value) const {
-        Eigen::VectorXd c = m_c;
-        c(0) -= value;
-        return ChebyshevExpansion(c, m_xmin, m_xmax);
+        ChebyshevExpansion ce(m_c.map(), m_xmin, m_xmax);
+        ce.m_c(0) -= value;
+        return ce;
     }
     ChebyshevExpansion ChebyshevExpansion::operator-() const{
-        Eigen::VectorXd c = m_c;
-        return ChebyshevExpansion(-c, m_xmin, m_xmax);
+        return ChebyshevExpansion(-m_c.map(), m_xmin, m_xmax);
     }
     ChebyshevExpansion& ChebyshevExpansion::operator*=(double value) {
-        m_c *= value;
+        m_c.map() *= value;
         return *this;
     }
     ChebyshevExpansion& ChebyshevExpansion::operator+=(double value) {
@@ -306,7 +573,7 @@ namespace ChebTools {
     ChebyshevExpansion ChebyshevExpansion::operator*(const ChebyshevExpansion &ce2) const {
 
         std::size_t order1 = this->m_c.size()-1,
-                    order2 = ce2.coef().size()-1;
+                    order2 = ce2.coef_view().size()-1;
         // The order of the product is the sum of the orders of the two expansions
         std::size_t Norder_product = order1 + order2;
 
@@ -314,7 +581,7 @@ namespace ChebTools {
         // and that of the donor
         Eigen::VectorXd a = Eigen::VectorXd::Zero(Norder_product+1),
                         b = Eigen::VectorXd::Zero(Norder_product+1);
-        a.head(order1+1) = this->m_c; b.head(order2+1) = ce2.coef();
+        a.head(order1+1) = this->m_c.map(); b.head(order2+1) = ce2.coef_view();
 
         // Get the matrices U and V from the libraries
         const Eigen::MatrixXd &U = u_matrix_library.get(Norder_product);
@@ -344,7 +611,7 @@ namespace ChebTools {
         // C_scaled = (b-a)/2*(chi*A) + ((b+a)/2)*A
         // where the coefficients in the second term need to be padded with a zero to have
         // the same order as the product of x*A
-        Eigen::VectorXd c_padded(N+2); c_padded << m_c, 0;
+        Eigen::VectorXd c_padded(N+2); c_padded << m_c.map(), 0;
         Eigen::VectorXd coefs = (((m_xmax - m_xmin)/2.0)*cc).array() + (m_xmax + m_xmin)/2.0*c_padded.array();
         return ChebyshevExpansion(coefs, m_xmin, m_xmax);
     };
@@ -401,14 +668,11 @@ namespace ChebTools {
         return (diff < 0.0).all() || (diff > 0.0).all();
     }
 
-    const vectype &ChebyshevExpansion::coef() const {
-        return m_c;
-    };
     /**
     * @brief Do a single input/single output evaluation of the Chebyshev expansion with the inputs scaled in [xmin, xmax]
     * @param x A value scaled in the domain [xmin,xmax]
     */
-    double ChebyshevExpansion::y_recurrence(const double x) {
+    double ChebyshevExpansion::y_recurrence(const double x) const {
         // Use the recurrence relationships to evaluate the Chebyshev expansion
         std::size_t Norder = m_c.size() - 1;
         // Scale x linearly into the domain [-1, 1]
@@ -417,13 +681,15 @@ namespace ChebTools {
         if (Norder == 0){ return m_c[0]; }
         if (Norder == 1) { return m_c[0] + m_c[1]*xscaled; }
 
-        vectype &o = m_recurrence_buffer;
-        o(0) = 1;
-        o(1) = xscaled;
-        for (int n = 1; n < Norder; ++n) {
-            o(n + 1) = 2 * xscaled*o(n) - o(n - 1);
+        // Only the last two values of T_n(x) are needed, and the sum is accumulated as we go,
+        // so there is no need for a buffer of all the T_n(x)
+        double T_nm1 = 1, T_n = xscaled, s = m_c[0] + m_c[1]*xscaled;
+        for (std::size_t n = 1; n < Norder; ++n) {
+            double T_np1 = 2 * xscaled*T_n - T_nm1;
+            s += m_c[n + 1]*T_np1;
+            T_nm1 = T_n; T_n = T_np1;
         }
-        return m_c.dot(o);
+        return s;
     }
     double ChebyshevExpansion::y_Clenshaw_xscaled(const double xscaled) const {
         // See https://en.wikipedia.org/wiki/Clenshaw_algorithm#Special_case_for_Chebyshev_series
@@ -461,20 +727,27 @@ namespace ChebTools {
     vectype ChebyshevExpansion::y_recurrence_xscaled(const vectype &xscaled) const {
         const std::size_t Norder = m_c.size() - 1;
 
-        Eigen::MatrixXd A(xscaled.size(), Norder + 1);
-
-        if (Norder == 0) { return m_c[0]*Eigen::MatrixXd::Ones(A.rows(), A.cols()); }
+        if (Norder == 0) { return vectype::Constant(xscaled.size(), m_c[0]); }
         if (Norder == 1) { return m_c[0] + m_c[1]*xscaled.array(); }
 
         // Use the recurrence relationships to evaluate the Chebyshev expansion
-        // In this case we do column-wise evaluations of the recurrence rule
-        A.col(0).fill(1);
-        A.col(1) = xscaled;
-        for (int n = 1; n < Norder; ++n) {
-            A.col(n + 1).array() = 2 * xscaled.array()*A.col(n).array() - A.col(n - 1).array();
+        // In this case we do blocked evaluations of the recurrence rule, with the scratch
+        // arrays living on the stack (the maximum size is known at compile-time)
+        using BlockArray = Eigen::Array<double, Eigen::Dynamic, 1, 0, recurrence_block_size, 1>;
+        vectype y(xscaled.size());
+        for (Eigen::Index istart = 0; istart < xscaled.size(); istart += recurrence_block_size) {
+            const Eigen::Index Nblock = std::min(recurrence_block_size, xscaled.size() - istart);
+            const auto x = xscaled.segment(istart, Nblock).array();
+            BlockArray T_nm1 = BlockArray::Ones(Nblock), T_n = x, T_np1(Nblock);
+            BlockArray s = m_c[0] + m_c[1]*x;
+            for (std::size_t n = 1; n < Norder; ++n) {
+                T_np1 = 2 * x*T_n - T_nm1;
+                s += m_c[n + 1]*T_np1;
+                T_nm1.swap(T_n); T_n.swap(T_np1);
+            }
+            y.segment(istart, Nblock) = s.matrix();
         }
-        // In this form, the matrix-vector product will yield the y values
-        return A*m_c;
+        return y;
     }
     vectype ChebyshevExpansion::y_Clenshaw_xscaled(const vectype &xscaled) const {
         const std::size_t Norder = m_c.size() - 1;
@@ -490,23 +763,102 @@ namespace ChebTools {
         return xscaled.array()*u_k.array() - u_kp1.array() + m_c(0);
     }
 
-    Eigen::MatrixXd ChebyshevExpansion::companion_matrix(const Eigen::VectorXd &coeffs) const {
-        Eigen::VectorXd new_mc = reduce_zeros(coeffs);
-        std::size_t Norder = new_mc.size() - 1;
-        Eigen::MatrixXd A = Eigen::MatrixXd::Zero(Norder, Norder);
-        // c_wrap wraps the first 0...Norder elements of the coefficient vector
-        Eigen::Map<const Eigen::VectorXd> c_wrap(&(new_mc[0]), Norder);
-        // First row
-        A(0, 1) = 1;
-        // Last row
-        A.row(Norder - 1) = -c_wrap / (2.0*new_mc(Norder));
-        A(Norder - 1, Norder - 2) += 0.5;
-        // All the other rows
-        for (int j = 1; j < Norder - 1; ++j) {
-            A(j, j - 1) = 0.5;
-            A(j, j + 1) = 0.5;
+    /// The constant \f$\gamma_n = nu/(1-nu)\f$ of Higham's rounding error analysis, with u the unit roundoff
+    static constexpr double gamma_n(double n) {
+        return n*(DBL_EPSILON/2)/(1 - n*(DBL_EPSILON/2));
+    }
+    /// A factor of at least \f$1+\gamma_n\f$ for \f$nu\le 1/2\f$, without the division, to cover the rounding in forming a bound of n terms
+    static double rounding_slack(std::size_t n) {
+        return 1 + static_cast<double>(2*n)*DBL_EPSILON;
+    }
+    /// A bound on \f$|T_k(\xi)|\f$ for all \f$k\le N\f$ and \f$|\xi|\le s\f$: 1 if \f$s\le 1\f$, otherwise \f$\rho^N\f$ with \f$\rho = s+\sqrt{s^2-1}\f$
+    static double Chebyshev_growth_bound(double s, std::size_t N) {
+        return (s <= 1) ? 1.0 : pow(s + sqrt(s*s - 1), static_cast<double>(N));
+    }
+    /// The Markov bound \f$\sum_k k^2|c_k|\f$ on the derivative of an expansion in [-1,1]
+    static double Markov_derivative_bound(const Eigen::Ref<const Eigen::VectorXd> &c) {
+        double m = 0;
+        for (Eigen::Index k = 1; k < c.size(); ++k) {
+            m += static_cast<double>(k)*static_cast<double>(k)*std::abs(c(k));
         }
-        return A;
+        return m;
+    }
+    /**
+    * @brief Clenshaw's recurrence for the expansion with coefficients c at xscaled, carrying along the sums that the error bounds need
+    * @param S The sum of the magnitudes of the computed \f$u_k\f$
+    * @param C The sum of the magnitudes of the coefficients
+    * @param M The Markov bound on the derivative
+    *
+    * The magnitudes of the terms of all the steps sum to at most \f$(2|x|+1)S + C\f$.  The extra sums are off the
+    * dependency chain of the recurrence, so they come nearly for free.
+    */
+    static double Clenshaw_with_sums(const double *c, const Eigen::Index Norder, const double xscaled, double &S, double &C, double &M) {
+        double u_kp1 = c[Norder], u_kp2 = 0, kd = static_cast<double>(Norder);
+        S = std::abs(u_kp1); C = std::abs(c[Norder]) + std::abs(c[0]); M = kd*kd*std::abs(c[Norder]);
+        for (Eigen::Index k = Norder - 1; k >= 1; --k) {
+            const double u_k = 2.0 * xscaled * u_kp1 - u_kp2 + c[k];
+            kd -= 1;
+            S += std::abs(u_k); C += std::abs(c[k]); M += kd*kd*std::abs(c[k]);
+            u_kp2 = u_kp1; u_kp1 = u_k;
+        }
+        return c[0] + xscaled * u_kp1 - u_kp2;
+    }
+    ValueWithError ChebyshevExpansion::y_with_error_xscaled(const double xscaled) const {
+        const std::size_t Norder = m_c.size() - 1;
+        if (Norder == 0) { return { m_c(0), 0.0 }; }
+        double S, C, M;
+        const double y = Clenshaw_with_sums(m_c.map().data(), static_cast<Eigen::Index>(Norder), xscaled, S, C, M);
+        // The last factor covers the rounding in the accumulation of the sums and in forming the bound
+        const double err = gamma_n(3)*((2*std::abs(xscaled) + 1)*S + C)*Chebyshev_growth_bound(std::abs(xscaled), Norder)*rounding_slack(3*Norder + 8);
+        return { y, err };
+    }
+    ValueWithError ChebyshevExpansion::y_with_error(const double x) const {
+        const std::size_t Norder = m_c.size() - 1;
+        if (Norder == 0) { return { m_c(0), 0.0 }; }
+        const double xscaled = scale_x(x);
+        double S, C, M;
+        const double y = Clenshaw_with_sums(m_c.map().data(), static_cast<Eigen::Index>(Norder), xscaled, S, C, M);
+        // The scaled x is off by at most dx, which moves the value by at most dx times the bound on the derivative
+        const double dx = gamma_n(5)*(2*std::abs(x) + std::abs(m_xmax) + std::abs(m_xmin))/std::abs(m_xmax - m_xmin);
+        const double err = gamma_n(3)*((2*std::abs(xscaled) + 1)*S + C)*Chebyshev_growth_bound(std::abs(xscaled), Norder)
+                         + dx*M*Chebyshev_growth_bound(std::abs(xscaled) + dx, Norder);
+        return { y, err*rounding_slack(3*Norder + 8) };
+    }
+    ValuesWithErrors ChebyshevExpansion::y_with_error(const vectype &x) const {
+        const std::size_t Norder = m_c.size() - 1;
+        const Eigen::Index npts = x.size();
+        ValuesWithErrors out{ Eigen::ArrayXd(npts), Eigen::ArrayXd(npts) };
+        const Eigen::ArrayXd xscaled = (2 * x.array() - (m_xmax + m_xmin)) / (m_xmax - m_xmin);
+        const Eigen::ArrayXd dx = gamma_n(5)*(2*x.array().abs() + std::abs(m_xmax) + std::abs(m_xmin))/std::abs(m_xmax - m_xmin);
+        if (Norder == 0) {
+            out.values.setConstant(m_c(0)); out.errors.setZero();
+            return out;
+        }
+        const double markov = Markov_derivative_bound(m_c.map()), C = m_c.map().cwiseAbs().sum();
+        // As in y_Clenshaw_xscaled, with the sum S of the magnitudes of the computed u_k carried along (see Clenshaw_with_sums)
+        Eigen::ArrayXd u_kp1 = Eigen::ArrayXd::Constant(npts, m_c[Norder]), u_kp2 = Eigen::ArrayXd::Zero(npts), u_k(npts);
+        Eigen::ArrayXd S = u_kp1.abs();
+        for (int k = static_cast<int>(Norder) - 1; k >= 1; --k) {
+            u_k = 2.0 * xscaled * u_kp1 - u_kp2 + m_c(k);
+            S += u_k.abs();
+            u_kp2.swap(u_kp1); u_kp1.swap(u_k);
+        }
+        out.values = m_c(0) + xscaled * u_kp1 - u_kp2;
+        out.errors = gamma_n(3)*((2*xscaled.abs() + 1)*S + C) + markov*dx;
+        // Outside [-1,1] (extrapolation, or the rounding of the scaling at the ends) the polynomials may exceed 1
+        if (((xscaled.abs() + dx) > 1).any()) {
+            for (Eigen::Index i = 0; i < npts; ++i) {
+                const double s = std::abs(xscaled(i));
+                out.errors(i) = gamma_n(3)*((2*s + 1)*S(i) + C)*Chebyshev_growth_bound(s, Norder)
+                              + markov*dx(i)*Chebyshev_growth_bound(s + dx(i), Norder);
+            }
+        }
+        out.errors *= rounding_slack(3*Norder + 8);
+        return out;
+    }
+
+    Eigen::MatrixXd ChebyshevExpansion::companion_matrix(const Eigen::VectorXd &coeffs) const {
+        return ColleagueMatrix(reduce_zeros(coeffs)).dense();
     }
     std::vector<double> ChebyshevExpansion::real_roots2(bool only_in_domain) const {
         //vector of roots to be returned
@@ -602,12 +954,16 @@ namespace ChebTools {
     std::vector<double> ChebyshevExpansion::real_roots(bool only_in_domain) const {
       //vector of roots to be returned
         std::vector<double> roots;
-        Eigen::VectorXd new_mc = reduce_zeros(m_c);
+        Eigen::VectorXd new_mc = reduce_zeros(m_c.map());
         //if the Chebyshev polynomial is just a constant, then there are no roots
         //if a_0=0 then there are infinite roots, but for our purposes, infinite roots doesnt make sense
         if (new_mc.size()<=1){ //we choose <=1 to account for the case of no coefficients
           return roots; //roots is empty
         }
+        //if zero is outside the bound c_0 +/- sum|c_k| of the range in the domain, there can be no root in the domain
+        else if (only_in_domain && !might_take_value(0.0)){
+          return roots;
+        }
 
         //if the Chebyshev polynomial is linear, then the only possible root is -a_0/a_1
         //we have this else if block because eigen is not a fan of 1x1 matrices
@@ -624,44 +980,24 @@ namespace ChebTools {
 
         //this for all cases of higher order polynomials
         else{
-          // The companion matrix is definitely lower Hessenberg, so we can skip the Hessenberg
-          // decomposition, and get the real eigenvalues directly.  These eigenvalues are defined
-          // in the domain [-1, 1], but it might also include values outside [-1, 1]
-          Eigen::VectorXcd eigs = eigenvalues(companion_matrix(new_mc), /* balance = */ true);
-
-
-          for (Eigen::Index i = 0; i < eigs.size(); ++i) {
-              if (std::abs(eigs(i).imag() / eigs(i).real()) < 1e-15) {
-                  double val_n11 = eigs(i).real();
-                  const bool is_in_domain = (val_n11 >= -1.0 && val_n11 <= 1.0);
-                  // Keep it if it is in domain, or if you just want all real roots
-                  if (!only_in_domain || is_in_domain) {
-                      // Rescale back into real-world values in [xmin,xmax] from [-1,1]
-                      double x = ((m_xmax - m_xmin)*val_n11 + (m_xmax + m_xmin)) / 2.0;
-                      roots.push_back(x);
-                  }
+          // The companion matrix is lower Hessenberg, so its transpose is upper Hessenberg and balancing (a
+          // diagonal similarity) keeps it so; the Hessenberg reduction is skipped, and the real eigenvalues are read
+          // directly from the real Schur form.  These eigenvalues are defined in the domain [-1, 1], but it might
+          // also include values outside [-1, 1]
+          Eigen::VectorXd real_eigs = ColleagueMatrix(new_mc).balance().real_eigenvalues();
+
+          for (Eigen::Index i = 0; i < real_eigs.size(); ++i) {
+              double val_n11 = real_eigs(i);
+              const bool is_in_domain = (val_n11 >= -1.0 && val_n11 <= 1.0);
+              // Keep it if it is in domain, or if you just want all real roots
+              if (!only_in_domain || is_in_domain) {
+                  // Rescale back into real-world values in [xmin,xmax] from [-1,1]
+                  double x = ((m_xmax - m_xmin)*val_n11 + (m_xmax + m_xmin)) / 2.0;
+                  roots.push_back(x);
               }
           }
         }
         return roots;
-
-        //// The companion matrix is definitely lower Hessenberg, so we can skip the Hessenberg
-        //// decomposition, and get the real eigenvalues directly.  These eigenvalues are defined
-        //// in the domain [-1, 1], but it might also include values outside [-1, 1]
-        //Eigen::VectorXd real_eigs = eigenvalues_upperHessenberg(companion_matrix().transpose(), /* balance = */ true);
-        //
-        //std::vector<double> roots;
-        //for (Eigen::Index i = 0; i < real_eigs.size(); ++i){
-        //    double val_n11 = real_eigs(i);
-        //    const bool is_in_domain = (val_n11 >= -1.0 && val_n11 <= 1.0);
-        //    // Keep it if it is in domain, or if you just want all real roots
-        //    if (!only_in_domain || is_in_domain){
-        //        // Rescale back into real-world values in [xmin,xmax] from [-1,1]
-        //        double x = ((m_xmax - m_xmin)*val_n11 + (m_xmax + m_xmin)) / 2.0;
-        //        roots.push_back(x);
-        //    }
-        //}
-        //return roots;
     }
     double ChebyshevExpansion::monotonic_solvex(double y) const {
         /*
@@ -721,25 +1057,135 @@ namespace ChebTools {
         return unscale_x(xscaled);
     }
 
+    ChebyshevExpansion ChebyshevExpansion::restrict(double a, double b) const {
+        const Eigen::Index N = m_c.size() - 1;
+        if (N == 0) {
+            return ChebyshevExpansion(m_c.map(), a, b);
+        }
+        if (N > restrict_FFT_threshold) {
+            // Sample at the Chebyshev-Lobatto nodes of [a, b], and transform back to coefficients
+            Eigen::VectorXd xscaled = ((b - a)*get_CLnodes(N).array() + (b + a))/2.0;
+            xscaled = (2*xscaled.array() - (m_xmax + m_xmin))/(m_xmax - m_xmin);
+            return factoryfFFT(N, y_Clenshaw_xscaled(xscaled), a, b);
+        }
+        // The interval [a, b] in the scaled coordinates of this expansion is t = sigma*s + mu, with s in [-1, 1]
+        const double alpha = scale_x(a), beta = scale_x(b);
+        const double sigma = (beta - alpha)/2, mu = (beta + alpha)/2;
+
+        // Multiply the expansion u of degree deg by (sigma*s + mu), using s*T_0 = T_1 and s*T_j = (T_{j-1} + T_{j+1})/2
+        auto times_t = [sigma, mu](const vectype& u, Eigen::Index deg, vectype& out) {
+            out.head(deg + 2).setZero();
+            for (Eigen::Index j = 0; j <= deg; ++j) {
+                out(j) += mu*u(j);
+                if (j == 0) {
+                    out(1) += sigma*u(0);
+                }
+                else {
+                    out(j - 1) += 0.5*sigma*u(j);
+                    out(j + 1) += 0.5*sigma*u(j);
+                }
+            }
+        };
+
+        // Clenshaw's recurrence, as in y_Clenshaw_xscaled, on vectors of coefficients; u_k is of degree N-k
+        vectype u_kp1 = vectype::Zero(N + 1), u_kp2 = vectype::Zero(N + 1), tu = vectype::Zero(N + 1);
+        u_kp1(0) = m_c(N);
+        for (Eigen::Index k = N - 1; k >= 1; --k) {
+            times_t(u_kp1, N - k - 1, tu);
+            // u_k = 2*t*u_{k+1} - u_{k+2} + c_k, stored in place of u_{k+2}
+            u_kp2 = 2*tu - u_kp2;
+            u_kp2(0) += m_c(k);
+            u_kp2.swap(u_kp1);
+        }
+        times_t(u_kp1, N - 1, tu);
+        tu -= u_kp2;
+        tu(0) += m_c(0);
+        return ChebyshevExpansion(tu, a, b);
+    }
+    ChebyshevExpansion ChebyshevExpansion::prolong(std::size_t Nnew) const {
+        const std::size_t N = m_c.size() - 1;
+        if (Nnew < N) {
+            throw std::invalid_argument("New degree [" + std::to_string(Nnew) + "] is less than the degree [" + std::to_string(N) + "]; use truncate_to");
+        }
+        // Built from the coefficients alone so that no nodal values at the old degree are carried over
+        ChebyshevExpansion ce(vectype::Zero(Nnew + 1), m_xmin, m_xmax);
+        ce.m_c.map().head(N + 1) = m_c.map();
+        return ce;
+    }
+    ChebyshevExpansion ChebyshevExpansion::truncate_to(std::size_t Nnew) const {
+        const std::size_t N = m_c.size() - 1;
+        if (Nnew > N) {
+            throw std::invalid_argument("New degree [" + std::to_string(Nnew) + "] is greater than the degree [" + std::to_string(N) + "]; use prolong");
+        }
+        return ChebyshevExpansion(m_c.map().head(Nnew + 1), m_xmin, m_xmax);
+    }
+    Eigen::VectorXd ChebyshevExpansion::resample_nodal_values(const Eigen::VectorXd &f, std::size_t Nnew) {
+        if (f.size() < 2) {
+            throw std::invalid_argument("At least two nodal values are needed");
+        }
+        const std::size_t Nold = f.size() - 1;
+        if (Nold == Nnew) {
+            return f;
+        }
+        return resampling_matrix_library.get(Nold, Nnew)*f;
+    }
+    std::vector<ChebyshevExpansion> ChebyshevExpansion::restrict_batch(const std::vector<double>& breakpoints, int Ndegree) const {
+        if (breakpoints.size() < 2) {
+            throw std::invalid_argument("At least two breakpoints are needed");
+        }
+        const std::size_t Nd = (Ndegree < 0) ? static_cast<std::size_t>(m_c.size() - 1) : static_cast<std::size_t>(Ndegree);
+        const Eigen::Index Nintervals = static_cast<Eigen::Index>(breakpoints.size()) - 1;
+        if (Nd == 0) {
+            // A constant is given by its value at the midpoint of each sub-interval
+            std::vector<ChebyshevExpansion> segments;
+            for (Eigen::Index i = 0; i < Nintervals; ++i) {
+                Eigen::VectorXd c(1); c << y_Clenshaw((breakpoints[i] + breakpoints[i + 1])/2);
+                segments.emplace_back(c, breakpoints[i], breakpoints[i + 1]);
+            }
+            return segments;
+        }
+
+        // Chebyshev-Lobatto nodes of each sub-interval (one per column), in the scaled coordinates of this expansion
+        const auto nodes = get_CLnodes(Nd).array();
+        Eigen::ArrayXXd x(Nd + 1, Nintervals);
+        for (Eigen::Index i = 0; i < Nintervals; ++i) {
+            double a = breakpoints[i], b = breakpoints[i + 1];
+            x.col(i) = (((b - a)*nodes + (b + a))/2.0 - (m_xmax + m_xmin)/2.0)*(2.0/(m_xmax - m_xmin));
+        }
+
+        // Clenshaw evaluation at all the nodes at once, as in y_Clenshaw_xscaled
+        const Eigen::Index N = m_c.size() - 1;
+        Eigen::ArrayXXd u_k, u_kp1 = Eigen::ArrayXXd::Constant(x.rows(), x.cols(), m_c(N)), u_kp2 = Eigen::ArrayXXd::Zero(x.rows(), x.cols());
+        for (Eigen::Index k = N - 1; k >= 1; --k) {
+            u_k = 2*x*u_kp1 - u_kp2 + m_c(k);
+            u_kp2.swap(u_kp1); u_kp1.swap(u_k);
+        }
+        Eigen::MatrixXd f = Eigen::MatrixXd::Constant(x.rows(), x.cols(), m_c(0));
+        if (N > 0) {
+            f = (m_c(0) + x*u_kp1 - u_kp2).matrix();
+        }
+
+        // All the coefficients from one matrix-matrix product
+        Eigen::MatrixXd c = l_matrix_library.get(Nd)*f;
+        std::vector<ChebyshevExpansion> segments;
+        segments.reserve(Nintervals);
+        for (Eigen::Index i = 0; i < Nintervals; ++i) {
+            segments.emplace_back(c.col(i), breakpoints[i], breakpoints[i + 1]);
+        }
+        return segments;
+    }
     std::vector<ChebyshevExpansion> ChebyshevExpansion::subdivide(std::size_t Nintervals, const std::size_t Norder) const {
 
         if (Nintervals == 1) {
             return std::vector<ChebyshevExpansion>(1, *this);
         }
 
-        std::vector<ChebyshevExpansion> segments;
         double deltax = (m_xmax - m_xmin) / (Nintervals - 1);
-
-        // Vector of values in the range [-1,1] as roots of a high-order Chebyshev
-        double NN = static_cast<double>(Norder);
-        Eigen::VectorXd xpts_n11 = (Eigen::VectorXd::LinSpaced(Norder + 1, 0, NN)*EIGEN_PI/NN).array().cos();
-
-        for (std::size_t i = 0; i < Nintervals - 1; ++i) {
-            double xmin = m_xmin + i*deltax, xmax = m_xmin + (i + 1)*deltax;
-            Eigen::VectorXd xrealworld = ((xmax - xmin)*xpts_n11.array() + (xmax + xmin)) / 2.0;
-            segments.push_back(factoryf(Norder, y(xrealworld), xmin, xmax));
+        std::vector<double> breakpoints(Nintervals);
+        for (std::size_t i = 0; i < Nintervals; ++i) {
+            breakpoints[i] = m_xmin + i*deltax;
         }
-        return segments;
+        return restrict_batch(breakpoints, static_cast<int>(Norder));
     }
     std::vector<double> ChebyshevExpansion::real_roots_intervals(const std::vector<ChebyshevExpansion> &segments, bool only_in_domain) {
         std::vector<double> roots;
@@ -823,7 +1269,7 @@ namespace ChebTools {
         }
         else {
             std::size_t N = m_c.size() - 1;
-            return u_matrix_library.get(N) * m_c;
+            return u_matrix_library.get(N) * m_c.map();
         }
     }
     ChebyshevExpansion ChebyshevExpansion::factoryf(const std::size_t N, const Eigen::VectorXd &f, const double xmin, const double xmax) {
@@ -872,37 +1318,39 @@ namespace ChebTools {
         }
         return pow(2, 1-static_cast<int>(n))*ChebyshevExpansion(c, xmin, xmax);
     }
+    void ChebyshevExpansion::deriv_inplace() {
+        // See Mason and Handscomb, p. 34, Eq. 2.52; the backward recurrence is that of chebder in
+        // https://github.com/numpy/numpy/blob/master/numpy/polynomial/chebyshev.py, which is O(N) rather than O(N^2)
+        const Eigen::Index N = m_c.size() - 1; ///< Order of the expansion
+        // Any cached nodal values were those of the function, not of its derivative
+        m_nodal_value_cache.resize(0);
+        if (N == 0) {
+            // The derivative of a constant
+            m_c(0) = 0;
+            return;
+        }
+        // The coefficient of T_{j-1} in the derivative is stored in slot j, which is no longer needed once it is visited
+        for (Eigen::Index j = N; j > 2; --j) {
+            double c_j = m_c(j);
+            m_c(j - 2) += (j*c_j)/(j - 2);
+            m_c(j) = 2*j*c_j;
+        }
+        if (N > 1) {
+            m_c(2) *= 4;
+        }
+        // Shift down by one to line the coefficients up with T_0, T_1, ...
+        double* c = m_c.data();
+        std::copy(c + 1, c + N + 1, c);
+        m_c.conservativeResize(N);
+        // Rescale the values if the range is not [-1,1].  Arrives from the derivative of d(xreal)/d(x_{-1,1})
+        m_c.map() /= (m_xmax - m_xmin)/2.0;
+    }
     ChebyshevExpansion ChebyshevExpansion::deriv(std::size_t Nderiv) const {
-        // See Mason and Handscomb, p. 34, Eq. 2.52
-        // and example in https ://github.com/numpy/numpy/blob/master/numpy/polynomial/chebyshev.py#L868-L964
-        vectype c = m_c;
+        ChebyshevExpansion d = *this;
         for (std::size_t deriv_counter = 0; deriv_counter < Nderiv; ++deriv_counter) {
-            std::size_t N = c.size() - 1, ///< Order of the expansion
-                        Nd = N - 1; ///< Order of the derivative expansion
-            vectype cd(N);
-            for (std::size_t r = 0; r <= Nd; ++r) {
-                cd(r) = 0;
-                for (std::size_t k = r + 1; k <= N; ++k) {
-                    // Terms where k-r is odd have values, otherwise, they are zero
-                    if ((k - r) % 2 == 1) {
-                        cd(r) += 2*k*c(k);
-                    }
-                }
-                // The first term with r = 0 is divided by 2 (the single prime in Mason and Handscomb, p. 34, Eq. 2.52)
-                if (r == 0) {
-                    cd(r) /= 2;
-                }
-                // Rescale the values if the range is not [-1,1].  Arrives from the derivative of d(xreal)/d(x_{-1,1})
-                cd(r) /= (m_xmax-m_xmin)/2.0;
-            }
-            if (Nderiv == 1) {
-                return ChebyshevExpansion(std::move(cd), m_xmin, m_xmax);
-            }
-            else{
-                c = cd;
-            }
+            d.deriv_inplace();
         }
-        return ChebyshevExpansion(std::move(c), m_xmin, m_xmax);
+        return d;
     };
     ChebyshevExpansion ChebyshevExpansion::integrate(std::size_t Nintegral) const {
         // See Mason and Handscomb, p. 33, Eq. 2.44 & 2.45
@@ -928,36 +1376,469 @@ namespace ChebTools {
         return ChebyshevExpansion(std::move(c), m_xmin, m_xmax);
     }
 
-    Eigen::VectorXd eigenvalues_upperHessenberg(const Eigen::MatrixXd &A, bool balance){
-        Eigen::VectorXd roots(A.cols());
-        Eigen::RealSchur<Eigen::MatrixXd> schur;
+    /// The object in slot, building and publishing it first if there is none; if two threads race, the first to publish wins
+    template<typename T, typename Builder>
+    static std::shared_ptr<const T> get_or_publish(std::shared_ptr<const T> &slot, const Builder &build) {
+        auto cached = std::atomic_load(&slot);
+        if (!cached) {
+            std::shared_ptr<const T> built = std::make_shared<T>(build());
+            if (std::atomic_compare_exchange_strong(&slot, &cached, built)) {
+                cached = built;
+            }
+        }
+        return cached;
+    }
 
-        if (balance) {
-            Eigen::MatrixXd Abalanced, D;
-            balance_matrix(A, Abalanced, D);
-            schur.computeFromHessenberg(Abalanced, Eigen::MatrixXd::Zero(Abalanced.rows(), Abalanced.cols()), false);
+    ColleaguePencil::ColleaguePencil(const ChebyshevExpansion &ce)
+        : m_c(ChebyshevExpansion::reduce_zeros(ce.coef_view())), m_xmin(ce.xmin()), m_xmax(ce.xmax()),
+          m_f(m_c), m_df(m_f.deriv(1)) {}
+    std::shared_ptr<const ColleaguePencil::MonotonicIntervals> ColleaguePencil::get_intervals() const {
+        return get_or_publish(m_intervals, [this]() {
+            MonotonicIntervals iv;
+            iv.t = { -1.0 };
+            if (m_c.size() > 2) {
+                // Stationary points; nearly-real eigenvalue pairs are kept too, since a spurious split is harmless
+                // but a missed one would merge two monotonic intervals
+                Eigen::VectorXd dc = ChebyshevExpansion::reduce_zeros(m_df.coef_view());
+                if (dc.size() == 2) {
+                    iv.t.push_back(-dc(0)/dc(1));
+                }
+                else if (dc.size() > 2) {
+                    Eigen::VectorXcd eigs = ColleagueMatrix(dc).balance().eigenvalues();
+                    for (Eigen::Index i = 0; i < eigs.size(); ++i) {
+                        if (std::abs(eigs(i).imag()) < 1e-8) {
+                            iv.t.push_back(eigs(i).real());
+                        }
+                    }
+                }
+            }
+            iv.t.erase(std::remove_if(iv.t.begin() + 1, iv.t.end(), [](double t) { return !(t > -1 && t < 1); }), iv.t.end());
+            iv.t.push_back(1.0);
+            std::sort(iv.t.begin(), iv.t.end());
+            for (double t : iv.t) {
+                iv.ft.push_back(m_f.y_Clenshaw_xscaled(t));
+            }
+            return iv;
+        });
+    }
+    std::shared_ptr<const ColleaguePencil::ShiftableHessenberg> ColleaguePencil::get_hessenberg() const {
+        return get_or_publish(m_hessenberg, [this]() {
+            ColleagueMatrix A(m_c);
+            A.balance();
+            ShiftableHessenberg sh;
+            sh.H = A.upper_Hessenberg();
+            const Eigen::VectorXd &D = A.balancing();
+            // The corner entry of the transpose is A(N-1,0) = -(c_0-c)/(2c_N), scaled by the balancing as D^-1 A D
+            sh.dcorner = 1/(2*m_c(m_c.size() - 1))*D(0)/D(A.size() - 1);
+            return sh;
+        });
+    }
+    std::vector<double> ColleaguePencil::roots_in_domain(double c) const {
+        std::vector<double> roots;
+        if (m_c.size() <= 1) {
+            return roots;
         }
-        else {
-            schur.computeFromHessenberg(A, Eigen::MatrixXd::Zero(A.rows(), A.cols()), false);
+        const auto iv = get_intervals();
+        for (std::size_t i = 0; i + 1 < iv->t.size(); ++i) {
+            double a = iv->t[i], b = iv->t[i + 1], fa = iv->ft[i] - c, fb = iv->ft[i + 1] - c;
+            if (fa*fb > 0) { continue; }
+            double t;
+            if (fa == 0) { t = a; }
+            else if (fb == 0) { t = b; }
+            else {
+                // Newton's method, falling back to bisection whenever a step leaves the bracket
+                t = (a*fb - b*fa)/(fb - fa);
+                for (int iter = 0; iter < 100; ++iter) {
+                    const double ft = m_f.y_Clenshaw_xscaled(t) - c;
+                    if (ft == 0) { break; }
+                    if ((ft < 0) == (fa < 0)) { a = t; fa = ft; } else { b = t; fb = ft; }
+                    const double dft = m_df.y_Clenshaw_xscaled(t);
+                    double tnew = t - ft/dft;
+                    if (!(tnew > a && tnew < b)) { tnew = (a + b)/2; }
+                    const bool done = std::abs(tnew - t) < 4*DBL_EPSILON || b - a < 4*DBL_EPSILON;
+                    t = tnew;
+                    if (done) { break; }
+                }
+            }
+            // A root at a shared end of two intervals is only reported once
+            double x = ((m_xmax - m_xmin)*t + (m_xmax + m_xmin)) / 2.0;
+            if (roots.empty() || std::abs(x - roots.back()) > 4*DBL_EPSILON*(std::abs(m_xmax) + std::abs(m_xmin))) {
+                roots.push_back(x);
+            }
         }
+        return roots;
+    }
+    std::vector<double> ColleaguePencil::eigenvalue_roots(double c, bool only_in_domain) const {
+        std::vector<double> roots;
+        auto add_root = [&](double val_n11) {
+            if (!only_in_domain || (val_n11 >= -1.0 && val_n11 <= 1.0)) {
+                roots.push_back(((m_xmax - m_xmin)*val_n11 + (m_xmax + m_xmin)) / 2.0);
+            }
+        };
+        if (m_c.size() <= 1) {
+            return roots;
+        }
+        else if (m_c.size() == 2) {
+            add_root(-(m_c(0) - c)/m_c(1));
+            return roots;
+        }
+        const auto sh = get_hessenberg();
+        Eigen::MatrixXd H = sh->H;
+        H(0, H.cols() - 1) += c*sh->dcorner;
+        Eigen::VectorXd real_eigs = eigenvalues_upperHessenberg(H, /* balance = */ false);
+        for (Eigen::Index i = 0; i < real_eigs.size(); ++i) {
+            add_root(real_eigs(i));
+        }
+        std::sort(roots.begin(), roots.end());
+        return roots;
+    }
+    std::vector<std::vector<double>> ColleaguePencil::real_roots(const std::vector<double> &cs, bool only_in_domain, int Nthreads) const {
+        std::vector<std::vector<double>> roots(cs.size());
+        parallel_for(static_cast<long>(cs.size()), Nthreads, [&](long i) {
+            roots[i] = real_roots(cs[i], only_in_domain);
+        });
+        return roots;
+    }
 
+    /**
+    * @brief All the eigenvalues of the upper Hessenberg matrix H, as real and imaginary parts
+    *
+    * The real Schur form is computed directly from H, skipping the Hessenberg reduction, and without accumulating the
+    * Schur vectors.  The eigenvalues are read off the 1x1 and 2x2 diagonal blocks of the quasi-triangular factor;
+    * RealSchur already splits 2x2 blocks with real eigenvalues into two 1x1 blocks, so a 2x2 block is a complex pair.
+    */
+    static void hessenberg_eigenvalues(const Eigen::MatrixXd &H, Eigen::VectorXd &wr, Eigen::VectorXd &wi) {
+        const Eigen::Index n = H.rows();
+        wr.resize(n); wi.resize(n);
+        if (n == 0) { return; }
+        // Not RealSchur(n), which would also allocate the N x N matrix U and the workspace of a Hessenberg reduction,
+        // neither of which is used here; only the quasi-triangular factor T is allocated, as a copy of H
+        Eigen::RealSchur<Eigen::MatrixXd> schur;
+        schur.computeFromHessenberg(H, Eigen::MatrixXd(), /* computeU = */ false);
+        if (schur.info() != Eigen::Success) {
+            throw std::invalid_argument("The QR iteration for the eigenvalues did not converge");
+        }
         const Eigen::MatrixXd &T = schur.matrixT();
+        for (Eigen::Index i = 0; i < n; ++i) {
+            if (i + 1 == n || T(i + 1, i) == 0) {
+                wr(i) = T(i, i); wi(i) = 0;
+            }
+            else {
+                // Complex conjugate pair from the 2x2 block, scaled to avoid overflow as in Eigen's EigenSolver
+                const double p = 0.5*(T(i, i) - T(i + 1, i + 1));
+                const double maxval = std::max(std::abs(p), std::max(std::abs(T(i + 1, i)), std::abs(T(i, i + 1))));
+                const double z = maxval*std::sqrt(std::abs((p/maxval)*(p/maxval) + (T(i + 1, i)/maxval)*(T(i, i + 1)/maxval)));
+                wr(i) = wr(i + 1) = T(i + 1, i + 1) + p;
+                wi(i) = z; wi(i + 1) = -z;
+                ++i;
+            }
+        }
+    }
+
+    /// The real eigenvalues of the upper Hessenberg matrix H
+    static Eigen::VectorXd real_eigenvalues_Hessenberg(const Eigen::MatrixXd &H) {
+        const double Hnorm = H.cwiseAbs().maxCoeff();
+        Eigen::VectorXd wr, wi;
+        hessenberg_eigenvalues(H, wr, wi);
+
+        // Real eigenvalues come out of 1x1 blocks, or 2x2 blocks with real eigenvalues, with exactly zero imaginary
+        // part.  A complex pair whose imaginary part is at the level of the rounding of the QR iteration, relative to
+        // the norm of the matrix, is a double real root that was split by rounding, and is kept as such
+        const double imag_tol = 10*DBL_EPSILON*Hnorm;
+        Eigen::VectorXd roots(wr.size());
         Eigen::Index j = 0;
-        for (int i = 0; i < T.cols(); ++i) {
-            if (i+1 < T.cols()-1 && std::abs(T(i+1,i)) > DBL_EPSILON){
-                // Nope, this is a 2x2 block, keep moving
-                i += 1;
+        for (Eigen::Index i = 0; i < wr.size(); ++i) {
+            if (std::abs(wi(i)) <= imag_tol) {
+                roots(j++) = wr(i);
+            }
+        }
+        roots.conservativeResize(j);
+        return roots;
+    }
+
+    /// The bound \f$c_0 \pm (\sum_{k\ge 1}|c_k| + {\rm allowance})\f$ on the range of an expansion over its domain
+    static RangeEnclosure coefficient_enclosure(const Eigen::Ref<const Eigen::VectorXd> &c, double allowance) {
+        const double S = c.tail(c.size() - 1).cwiseAbs().sum() + allowance;
+        return { c(0) - S, c(0) + S };
+    }
+    /// The allowance for rounding in a range bound of degree N from coefficients with the sum of magnitudes S
+    static double enclosure_allowance(std::size_t N, double S) {
+        return 4*static_cast<double>(N + 1)*DBL_EPSILON*S;
+    }
+    bool ChebyshevExpansion::might_take_value(double y) const {
+        const auto c = m_c.map();
+        const double S = c.tail(c.size() - 1).cwiseAbs().sum();
+        return std::abs(y - c(0)) <= S + enclosure_allowance(c.size() - 1, S + std::abs(c(0)));
+    }
+    SingularityEstimate ChebyshevExpansion::nearest_singularity() const {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const auto c = m_c.map();
+        const double cmax = c.cwiseAbs().maxCoeff();
+        // Coefficients at the rounding level carry no information about the decay
+        Eigen::Index nend = c.size() - 1;
+        while (nend > 0 && std::abs(c(nend)) <= 100*DBL_EPSILON*cmax) { --nend; }
+        const Eigen::Index nstart = std::max<Eigen::Index>(1, nend/2), Neq = nend - nstart - 1;
+        if (Neq < 3) {
+            return { {nan, nan}, nan, nan };
+        }
+        // Fit c_{n+2} = p*c_{n+1} + q*c_n for n in [nstart, nend-2]
+        const Eigen::VectorXd t = c.segment(nstart, nend - nstart + 1)/cmax;
+        Eigen::MatrixXd A(Neq, 2);
+        A.col(0) = t.segment(1, Neq);
+        A.col(1) = t.head(Neq);
+        const Eigen::VectorXd rhs = t.tail(Neq);
+        const Eigen::Vector2d pq = A.colPivHouseholderQr().solve(rhs);
+        const double misfit = (A*pq - rhs).norm()/rhs.norm();
+        const double p = pq(0), q = pq(1);
+        const std::complex<double> sqrtdisc = std::sqrt(std::complex<double>(p*p + 4*q, 0));
+        std::complex<double> r1 = (p + sqrtdisc)/2.0, r2 = (p - sqrtdisc)/2.0;
+        const std::complex<double> r = (std::abs(r1) >= std::abs(r2)) ? r1 : r2;
+        if (!(std::abs(r) > 0) || !std::isfinite(std::abs(r)) || !std::isfinite(misfit)) {
+            return { {nan, nan}, nan, nan };
+        }
+        const std::complex<double> z = (r + 1.0/r)/2.0;
+        // Map from [-1,1] into [xmin,xmax]
+        return { (m_xmax - m_xmin)/2*z + (m_xmax + m_xmin)/2, 1/std::abs(r), misfit };
+    }
+    RangeEnclosure ChebyshevExpansion::range_enclosure(double a, double b, std::size_t max_bisections) const {
+        if (!(b > a)) {
+            throw std::invalid_argument("The sub-interval [" + std::to_string(a) + "," + std::to_string(b) + "] is empty");
+        }
+        const std::size_t N = m_c.size() - 1;
+        // The rounding of the re-expansion grows with the magnitude of the coefficients, and outside the domain also with that of the polynomials
+        const double Sorig = m_c.map().cwiseAbs().sum()*Chebyshev_growth_bound(std::max(std::abs(scale_x(a)), std::abs(scale_x(b))), N);
+        struct Piece {
+            double a, b; ///< The bounds of the piece
+            RangeEnclosure r; ///< The enclosure of the range over the piece
+        };
+        // Bound the range over [a, b], capped by the enclosure of the parent, and return the values at the ends
+        auto bound = [&](double a, double b, const RangeEnclosure &parent, double &fa, double &fb) {
+            const ChebyshevExpansion piece = (a == m_xmin && b == m_xmax) ? *this : restrict(a, b);
+            const auto c = piece.coef_view();
+            fb = c.sum();
+            fa = 0;
+            for (Eigen::Index k = 0; k < c.size(); ++k) { fa += (k % 2 == 0) ? c(k) : -c(k); }
+            RangeEnclosure r = coefficient_enclosure(c, enclosure_allowance(N, Sorig + c.cwiseAbs().sum()));
+            return RangeEnclosure{ std::max(r.ymin, parent.ymin), std::min(r.ymax, parent.ymax) };
+        };
+        const double inf = std::numeric_limits<double>::infinity();
+        double fa, fb;
+        std::vector<Piece> pieces = { Piece{ a, b, bound(a, b, RangeEnclosure{ -inf, inf }, fa, fb) } };
+        // The values found at the ends of the pieces are in the range, so they bound how much tighter the enclosure can get
+        double inner_min = std::min(fa, fb), inner_max = std::max(fa, fb);
+        for (std::size_t iter = 0; iter < max_bisections; ++iter) {
+            auto by_min = std::min_element(pieces.begin(), pieces.end(), [](const Piece &l, const Piece &r) { return l.r.ymin < r.r.ymin; });
+            auto by_max = std::max_element(pieces.begin(), pieces.end(), [](const Piece &l, const Piece &r) { return l.r.ymax < r.r.ymax; });
+            const double gap_min = inner_min - by_min->r.ymin, gap_max = by_max->r.ymax - inner_max;
+            if (std::max(gap_min, gap_max) <= 0) { break; }
+            const Piece p = (gap_min >= gap_max) ? *by_min : *by_max;
+            const std::size_t i = ((gap_min >= gap_max) ? by_min : by_max) - pieces.begin();
+            const double m = (p.a + p.b)/2;
+            double fl, fm, fr;
+            pieces[i] = Piece{ p.a, m, bound(p.a, m, p.r, fl, fm) };
+            pieces.push_back(Piece{ m, p.b, bound(m, p.b, p.r, fm, fr) });
+            inner_min = std::min(inner_min, fm); inner_max = std::max(inner_max, fm);
+        }
+        RangeEnclosure r = pieces.front().r;
+        for (const auto &p : pieces) {
+            r.ymin = std::min(r.ymin, p.r.ymin); r.ymax = std::max(r.ymax, p.r.ymax);
+        }
+        return r;
+    }
+    Extremum ChebyshevExpansion::minimize(double a, double b) const {
+        if (!(b >= a)) {
+            throw std::invalid_argument("The interval [" + std::to_string(a) + "," + std::to_string(b) + "] is empty");
+        }
+        Extremum best = { a, y(a) };
+        const double yb = y(b);
+        if (yb < best.y) { best = { b, yb }; }
+        if (b == a) { return best; }
+        struct Piece {
+            double a, b; ///< The bounds of the piece
+            int depth; ///< The number of bisections that led to the piece
+            ChebyshevExpansion f; ///< The expansion re-expanded on the piece, with its negligible tail dropped
+            double dropped; ///< The sum of the magnitudes of all the coefficients dropped on the way to this piece
+        };
+        // Drop the trailing coefficients whose magnitudes sum to no more than the rounding of the re-expansion, keeping
+        // account of them, so that the pieces get cheaper to bisect as they shrink
+        auto make_piece = [](double a, double b, int depth, const ChebyshevExpansion &f, double dropped) {
+            const auto c = f.coef_view();
+            const double tol = 4*static_cast<double>(c.size())*DBL_EPSILON*c.cwiseAbs().sum();
+            double tail = 0;
+            Eigen::Index n = c.size() - 1;
+            while (n > 0 && tail + std::abs(c(n)) <= tol) { tail += std::abs(c(n)); --n; }
+            return Piece{ a, b, depth, (n + 1 < c.size()) ? f.truncate_to(n) : f, dropped + tail };
+        };
+        // A first level of pieces, re-expanded all together, each of which should be of about the degree that is root-found
+        const Eigen::Index N = m_c.size() - 1;
+        const int Npieces = static_cast<int>(std::max<Eigen::Index>(1, N/optimize_rootfind_degree));
+        std::vector<Piece> stack;
+        if (Npieces == 1) {
+            stack.push_back(make_piece(a, b, 0, (a == m_xmin && b == m_xmax) ? *this : restrict(a, b), 0.0));
+        }
+        else {
+            std::vector<double> breaks(Npieces + 1);
+            for (int i = 0; i <= Npieces; ++i) { breaks[i] = (i == Npieces) ? b : a + (b - a)*i/Npieces; }
+            const auto pieces = restrict_batch(breaks);
+            for (int i = Npieces - 1; i >= 0; --i) {
+                stack.push_back(make_piece(breaks[i], breaks[i + 1], 0, pieces[i], 0.0));
+            }
+        }
+        while (!stack.empty()) {
+            const Piece p = stack.back(); stack.pop_back();
+            const auto c = p.f.coef_view();
+            // Prune with the enclosure c_0 - sum|c_k|, widened by the dropped coefficients and a little for the rounding of the re-expansion
+            const double S = c.tail(c.size() - 1).cwiseAbs().sum() + p.dropped;
+            if (c(0) - S - 16*static_cast<double>(N + 1)*DBL_EPSILON*(std::abs(c(0)) + S) > best.y) { continue; }
+            // The midpoint improves the best value cheaply, which prunes more of the pieces to come
+            const double xm = (p.a + p.b)/2, ym = y(xm);
+            if (ym < best.y) { best = { xm, ym }; }
+            const ChebyshevExpansion dp = p.f.deriv(1);
+            const Eigen::Index degree = reduce_zeros(dp.coef_view()).size() - 1;
+            if (degree <= optimize_rootfind_degree || p.depth >= optimize_max_depth) {
+                for (double x : dp.real_roots(true)) {
+                    const double yx = y(x);
+                    if (yx < best.y) { best = { x, yx }; }
+                }
             }
-            else{
-                // This is a 1x1 block, keep this (real) eigenvalue
-                roots(j) = T(i, i);
-                j++;
+            else {
+                // The half nearer the best value so far is searched first
+                Piece left = make_piece(p.a, xm, p.depth + 1, p.f.restrict(p.a, xm), p.dropped);
+                Piece right = make_piece(xm, p.b, p.depth + 1, p.f.restrict(xm, p.b), p.dropped);
+                if (best.x < xm) { stack.push_back(std::move(right)); stack.push_back(std::move(left)); }
+                else { stack.push_back(std::move(left)); stack.push_back(std::move(right)); }
+            }
+        }
+        return best;
+    }
+    Extremum ChebyshevExpansion::maximize(double a, double b) const {
+        Extremum e = (-(*this)).minimize(a, b);
+        return { e.x, y(e.x) };
+    }
+
+    std::vector<RangeEnclosure> ChebyshevExpansion::range_enclosure_batch(const std::vector<double>& breakpoints, std::size_t max_bisections, int Nthreads) const {
+        if (breakpoints.size() < 2) {
+            throw std::invalid_argument("At least two breakpoints are needed");
+        }
+        std::vector<RangeEnclosure> out(breakpoints.size() - 1);
+        if (max_bisections == 0) {
+            const std::size_t N = m_c.size() - 1;
+            const double S = m_c.map().cwiseAbs().sum()*Chebyshev_growth_bound(std::max(std::abs(scale_x(breakpoints.front())), std::abs(scale_x(breakpoints.back()))), N);
+            const auto pieces = restrict_batch(breakpoints);
+            for (std::size_t i = 0; i < pieces.size(); ++i) {
+                const auto c = pieces[i].coef_view();
+                out[i] = coefficient_enclosure(c, enclosure_allowance(N, S + c.cwiseAbs().sum()));
             }
+            return out;
         }
-        roots.conservativeResize(j-1);
+        parallel_for(static_cast<long>(out.size()), Nthreads, [&](long i) {
+            out[i] = range_enclosure(breakpoints[i], breakpoints[i + 1], max_bisections);
+        });
+        return out;
+    }
+
+    Eigen::ArrayXXd evaluate_many(const std::vector<ChebyshevExpansion> &exps, const Eigen::Ref<const Eigen::ArrayXd> &x, int Nthreads) {
+        Eigen::ArrayXXd y(exps.size(), x.size());
+        parallel_for(static_cast<long>(exps.size()), Nthreads, [&](long i) {
+            y.row(i) = exps[i].y(x.matrix()).array().transpose();
+        });
+        return y;
+    }
+
+    std::vector<std::vector<double>> real_roots_many(const std::vector<ChebyshevExpansion> &exps, bool only_in_domain, int Nthreads) {
+        std::vector<std::vector<double>> roots(exps.size());
+        parallel_for(static_cast<long>(exps.size()), Nthreads, [&](long i) {
+            roots[i] = exps[i].real_roots(only_in_domain);
+        });
         return roots;
     }
 
+    Eigen::ArrayXd monotonic_solvex_many(const ChebyshevExpansion &ce, const Eigen::Ref<const Eigen::ArrayXd> &ys, int Nthreads) {
+        // The nodal values are needed by every solve, so they are obtained once
+        ChebyshevExpansion cached = ce;
+        cached.cache_nodal_function_values(ce.get_node_function_values());
+        Eigen::ArrayXd x(ys.size());
+        parallel_for(static_cast<long>(ys.size()), Nthreads, [&](long i) {
+            try {
+                x(i) = cached.monotonic_solvex(ys(i));
+            }
+            catch (const std::invalid_argument &) {
+                x(i) = std::numeric_limits<double>::quiet_NaN();
+            }
+        });
+        return x;
+    }
+
+    Eigen::VectorXd eigenvalues_upperHessenberg(const Eigen::MatrixXd &A, bool balance){
+        Eigen::MatrixXd H;
+        if (balance) {
+            Eigen::MatrixXd D;
+            balance_matrix(A, H, D);
+        }
+        else {
+            H = A;
+        }
+        return real_eigenvalues_Hessenberg(H);
+    }
+
+    ColleagueMatrix::ColleagueMatrix(const Eigen::Ref<const Eigen::VectorXd> &c) {
+        const Eigen::Index N = c.size() - 1;
+        if (N < 2 || c(N) == 0) {
+            throw std::invalid_argument("The colleague matrix needs a series of degree at least 2 with nonzero last coefficient");
+        }
+        m_lower = Eigen::VectorXd::Constant(N - 2, 0.5);
+        m_upper = Eigen::VectorXd::Constant(N - 1, 0.5);
+        m_upper(0) = 1;
+        m_lastrow = -c.head(N)/(2.0*c(N));
+        m_lastrow(N - 2) += 0.5;
+        m_D = Eigen::VectorXd::Ones(N);
+    }
+    ColleagueMatrix &ColleagueMatrix::balance() {
+        Eigen::VectorXd D;
+        balance_colleague(m_lower, m_upper, m_lastrow, D);
+        m_D.array() *= D.array();
+        return *this;
+    }
+    Eigen::VectorXd ColleagueMatrix::operator*(const Eigen::VectorXd &v) const {
+        const Eigen::Index N = size();
+        if (v.size() != N) {
+            throw std::invalid_argument("Vector must be of size " + std::to_string(N));
+        }
+        Eigen::VectorXd out(N);
+        out.head(N - 1) = m_upper.cwiseProduct(v.tail(N - 1));
+        out.segment(1, N - 2) += m_lower.cwiseProduct(v.head(N - 2));
+        out(N - 1) = m_lastrow.dot(v);
+        return out;
+    }
+    Eigen::MatrixXd ColleagueMatrix::dense() const {
+        const Eigen::Index N = size();
+        Eigen::MatrixXd A = Eigen::MatrixXd::Zero(N, N);
+        for (Eigen::Index j = 0; j < m_upper.size(); ++j) { A(j, j + 1) = m_upper(j); }
+        for (Eigen::Index j = 0; j < m_lower.size(); ++j) { A(j + 1, j) = m_lower(j); }
+        A.row(N - 1) = m_lastrow.transpose();
+        return A;
+    }
+    Eigen::MatrixXd ColleagueMatrix::upper_Hessenberg() const {
+        const Eigen::Index N = size();
+        Eigen::MatrixXd H = Eigen::MatrixXd::Zero(N, N);
+        for (Eigen::Index j = 0; j < m_upper.size(); ++j) { H(j + 1, j) = m_upper(j); }
+        for (Eigen::Index j = 0; j < m_lower.size(); ++j) { H(j, j + 1) = m_lower(j); }
+        H.col(N - 1) = m_lastrow;
+        return H;
+    }
+    Eigen::VectorXcd ColleagueMatrix::eigenvalues() const {
+        Eigen::VectorXd wr, wi;
+        hessenberg_eigenvalues(upper_Hessenberg(), wr, wi);
+        Eigen::VectorXcd eigs(wr.size());
+        eigs.real() = wr;
+        eigs.imag() = wi;
+        return eigs;
+    }
+    Eigen::VectorXd ColleagueMatrix::real_eigenvalues() const {
+        Eigen::MatrixXd H = upper_Hessenberg();
+        return real_eigenvalues_Hessenberg(H);
+    }
+
     Eigen::VectorXcd eigenvalues(const Eigen::MatrixXd &A, bool balance) {
         if (balance) {
             Eigen::MatrixXd Abalanced, D;
@@ -969,4 +1850,906 @@ namespace ChebTools {
         }
     }
 
+    std::shared_ptr<const ExtremaCache> ChebyshevCollection::build_extrema_cache(int Nthreads) const {
+        // Stationary points of each expansion, from the roots in the domain of the derivative (the eigenvalues of its
+        // balanced colleague matrix); each expansion is independent of the others so the loop can run in parallel
+        std::vector<std::vector<Extremum>> piece_extrema(m_exps.size());
+        parallel_for(static_cast<long>(m_exps.size()), Nthreads, [&](long i) {
+            const auto& ex = m_exps[i];
+            for (double x : ex.deriv(1).real_roots(true)) {
+                piece_extrema[i].push_back({ x, ex.y_Clenshaw(x) });
+            }
+            std::sort(piece_extrema[i].begin(), piece_extrema[i].end(), [](const Extremum& a, const Extremum& b) { return a.x < b.x; });
+        });
+
+        auto cache = std::make_shared<ExtremaCache>();
+        const double xmin = m_exps.front().xmin(), xmax = m_exps.back().xmax();
+        // A root exactly at a breakpoint can be found by both neighboring expansions
+        const double xtol = 1e-12*(xmax - xmin);
+        for (auto& exts : piece_extrema) {
+            for (auto& ext : exts) {
+                if (!cache->extrema.empty() && ext.x - cache->extrema.back().x < xtol) { continue; }
+                cache->extrema.push_back(ext);
+            }
+        }
+
+        // Split the domain at the extrema, and find the global extrema from the values
+        // at the stationary points and the ends of the domain
+        std::vector<Extremum> points;
+        if (cache->extrema.empty() || cache->extrema.front().x > xmin + xtol) {
+            points.push_back({ xmin, m_exps.front().y_Clenshaw(xmin) });
+        }
+        points.insert(points.end(), cache->extrema.begin(), cache->extrema.end());
+        if (points.back().x < xmax - xtol) {
+            points.push_back({ xmax, m_exps.back().y_Clenshaw(xmax) });
+        }
+        cache->global_min = points.front(); cache->global_max = points.front();
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (points[i].y < cache->global_min.y) { cache->global_min = points[i]; }
+            if (points[i].y > cache->global_max.y) { cache->global_max = points[i]; }
+            if (i + 1 < points.size()) {
+                cache->monotonic_ranges.push_back({ points[i].x, points[i + 1].x, points[i + 1].y > points[i].y });
+            }
+        }
+        return cache;
+    }
+
+    std::vector<double> ChebyshevCollection::get_breakpoints() const {
+        std::vector<double> breakpoints;
+        for (auto& ex : m_exps) {
+            breakpoints.push_back(ex.xmin());
+        }
+        breakpoints.push_back(m_exps.back().xmax());
+        return breakpoints;
+    }
+
+    ChebyshevCollection ChebyshevCollection::combine(const ChebyshevCollection& other, const std::function<ChebyshevExpansion(const ChebyshevExpansion&, const ChebyshevExpansion&)>& op, int Nthreads) const {
+        const auto bp1 = get_breakpoints(), bp2 = other.get_breakpoints();
+        const double xmin = bp1.front(), xmax = bp1.back();
+        const double xtol = 1e-12*(xmax - xmin);
+        if (std::abs(bp2.front() - xmin) > xtol || std::abs(bp2.back() - xmax) > xtol) {
+            throw std::invalid_argument("The collections must span the same domain");
+        }
+
+        // Merge the sets of breakpoints, dropping ones that are (nearly) coincident
+        std::vector<double> all(bp1.size() + bp2.size()), breakpoints;
+        std::merge(bp1.begin(), bp1.end(), bp2.begin(), bp2.end(), all.begin());
+        for (double x : all) {
+            if (breakpoints.empty() || x - breakpoints.back() > xtol) {
+                breakpoints.push_back(x);
+            }
+        }
+        breakpoints.back() = xmax;
+
+        // An expansion on its own interval is used as-is, otherwise it is restricted in coefficient space
+        auto restricted = [xtol](const ChebyshevExpansion& ex, double a, double b) {
+            if (std::abs(ex.xmin() - a) < xtol && std::abs(ex.xmax() - b) < xtol) {
+                return ChebyshevExpansion(ex.coef_view(), a, b);
+            }
+            return ex.restrict(a, b);
+        };
+
+        const int Nintervals = static_cast<int>(breakpoints.size()) - 1;
+        Container exps(Nintervals, m_exps.front());
+        parallel_for(Nintervals, Nthreads, [&](long i) {
+            const double a = breakpoints[i], b = breakpoints[i + 1], xmid = (a + b)/2;
+            const auto& ex1 = m_exps[get_index(xmid)];
+            const auto& ex2 = other.m_exps[other.get_index(xmid)];
+            exps[i] = op(restricted(ex1, a, b), restricted(ex2, a, b));
+        });
+        return ChebyshevCollection(exps);
+    }
+    ChebyshevCollection ChebyshevCollection::operator+(const ChebyshevCollection& other) const {
+        return combine(other, [](const ChebyshevExpansion& ex1, const ChebyshevExpansion& ex2) { return ex1 + ex2; });
+    }
+    ChebyshevCollection ChebyshevCollection::operator-(const ChebyshevCollection& other) const {
+        return combine(other, [](const ChebyshevExpansion& ex1, const ChebyshevExpansion& ex2) { return ex1 - ex2; });
+    }
+    ChebyshevCollection ChebyshevCollection::operator*(const ChebyshevCollection& other) const {
+        return combine(other, [](const ChebyshevExpansion& ex1, const ChebyshevExpansion& ex2) { return ex1 * ex2; });
+    }
+    ChebyshevCollection ChebyshevCollection::operator/(const ChebyshevCollection& other) const {
+        return combine(other, [](const ChebyshevExpansion& ex1, const ChebyshevExpansion& ex2) { return ex1 / ex2; });
+    }
+    ChebyshevCollection ChebyshevCollection::apply(std::function<Eigen::ArrayXd(const Eigen::ArrayXd &)> &f) const {
+        // Not parallelized because f may not be safe to call concurrently (e.g., a python callback)
+        Container exps;
+        for (auto& ex : m_exps) {
+            exps.push_back(ex.apply(f));
+        }
+        return ChebyshevCollection(exps);
+    }
+
+    std::string generate_C_source(const ChebyshevCollection &cc, const std::string &name, int max_table_level) {
+        const auto &exps = cc.get_exps();
+        const std::size_t Npieces = exps.size();
+        const double xmin = exps.front().xmin(), xmax = exps.back().xmax(), range = xmax - xmin;
+
+        std::ostringstream o;
+        o << std::setprecision(17);
+        auto to_string_precise = [](double v) { std::ostringstream s; s << std::setprecision(17) << v; return s.str(); };
+        auto write_array = [&o](const std::string &decl, const std::vector<double> &values) {
+            o << "static const " << decl << "[" << values.size() << "] = {";
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                o << ((i % 4 == 0) ? "\n    " : " ") << values[i] << ((i + 1 < values.size()) ? "," : "");
+            }
+            o << "\n};\n";
+        };
+
+        o << "/* Generated by ChebTools from a ChebyshevCollection of " << Npieces << " expansions on [" << xmin << ", " << xmax << "] */\n";
+        o << "#include <math.h>\n\n";
+
+        // Coefficients of all the pieces end to end, and the constants that scale x into [-1, 1]
+        std::vector<double> coef, sum, width;
+        std::vector<std::size_t> degree, offsets;
+        for (const auto &ex : exps) {
+            const auto c = ex.coef_view();
+            offsets.push_back(coef.size());
+            coef.insert(coef.end(), c.data(), c.data() + c.size());
+            degree.push_back(c.size() - 1);
+            sum.push_back(ex.xmax() + ex.xmin());
+            width.push_back(ex.xmax() - ex.xmin());
+        }
+        write_array("double " + name + "_coef", coef);
+        write_array("double " + name + "_sum", sum);
+        write_array("double " + name + "_width", width);
+        auto write_int_array = [&o](const std::string &decl, const std::vector<std::size_t> &values) {
+            o << "static const " << decl << "[" << values.size() << "] = {";
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                o << ((i % 16 == 0) ? "\n    " : " ") << values[i] << ((i + 1 < values.size()) ? "," : "");
+            }
+            o << "\n};\n";
+        };
+        write_int_array("int " + name + "_offset", offsets);
+
+        // Unrolled Clenshaw, with the same order of operations as ChebyshevExpansion::y_Clenshaw_xscaled
+        std::vector<std::size_t> degrees = degree;
+        std::sort(degrees.begin(), degrees.end());
+        degrees.erase(std::unique(degrees.begin(), degrees.end()), degrees.end());
+        if (degrees.size() > 1) {
+            write_int_array("int " + name + "_degree", degree);
+        }
+        o << "\n";
+        for (auto N : degrees) {
+            o << "static double " << name << "_clenshaw_" << N << "(const double *c, double t) {\n";
+            if (N == 0) {
+                o << "    (void)t;\n    return c[0];\n}\n\n";
+                continue;
+            }
+            o << "    double u_k, u_kp1 = c[" << N << "], u_kp2 = 0;\n";
+            for (std::size_t k = N - 1; k >= 1; --k) {
+                o << "    u_k = 2.0*t*u_kp1 - u_kp2 + c[" << k << "]; u_kp2 = u_kp1; u_kp1 = u_k;\n";
+            }
+            o << "    (void)u_k;\n    return c[0] + t*u_kp1 - u_kp2;\n}\n\n";
+        }
+
+        // The lookup of the piece
+        bool uniform = true;
+        for (std::size_t i = 0; i < Npieces; ++i) {
+            const double expected = xmin + range*static_cast<double>(i)/static_cast<double>(Npieces);
+            if (std::abs(exps[i].xmin() - expected) > 1e-12*range) { uniform = false; break; }
+        }
+        int level = -1;
+        if (!uniform) {
+            for (int L = 1; L <= max_table_level && level < 0; ++L) {
+                bool on_grid = true;
+                for (const auto &ex : exps) {
+                    const double k = (ex.xmin() - xmin)/range*std::ldexp(1.0, L);
+                    if (std::abs(k - std::round(k)) > 1e-9) { on_grid = false; break; }
+                }
+                if (on_grid) { level = L; }
+            }
+        }
+        std::string lookup;
+        if (uniform) {
+            lookup = "    int i = (int)((x - " + to_string_precise(xmin) + ")*" + to_string_precise(Npieces/range) + ");\n"
+                     "    if (i > " + std::to_string(Npieces - 1) + ") { i = " + std::to_string(Npieces - 1) + "; }\n";
+        }
+        else if (level > 0) {
+            const std::size_t Ncells = std::size_t(1) << level;
+            std::vector<std::size_t> table(Ncells);
+            std::size_t piece = 0;
+            for (std::size_t j = 0; j < Ncells; ++j) {
+                const double cell_left = xmin + range*static_cast<double>(j)/static_cast<double>(Ncells);
+                while (piece + 1 < Npieces && exps[piece + 1].xmin() <= cell_left + 1e-12*range) { ++piece; }
+                table[j] = piece;
+            }
+            write_int_array(std::string((Npieces <= 65536) ? "unsigned short " : "int ") + name + "_table", table);
+            o << "\n";
+            lookup = "    int j = (int)((x - " + to_string_precise(xmin) + ")*" + to_string_precise(Ncells/range) + ");\n"
+                     "    if (j > " + std::to_string(Ncells - 1) + ") { j = " + std::to_string(Ncells - 1) + "; }\n"
+                     "    int i = " + name + "_table[j];\n";
+        }
+        else {
+            std::vector<double> breaks;
+            for (const auto &ex : exps) { breaks.push_back(ex.xmin()); }
+            write_array("double " + name + "_breaks", breaks);
+            o << "\n";
+            lookup = "    int lo = 0, hi = " + std::to_string(Npieces) + ";\n"
+                     "    while (hi - lo > 1) { int mid = (lo + hi)/2; if (x >= " + name + "_breaks[mid]) { lo = mid; } else { hi = mid; } }\n"
+                     "    int i = lo;\n";
+        }
+
+        o << "double " << name << "(double x) {\n";
+        o << "    if (!(x >= " << xmin << " && x <= " << xmax << ")) { return NAN; }\n";
+        o << lookup;
+        o << "    const double t = (2*x - " << name << "_sum[i])/" << name << "_width[i];\n";
+        o << "    const double *c = " << name << "_coef + " << name << "_offset[i];\n";
+        if (degrees.size() == 1) {
+            o << "    return " << name << "_clenshaw_" << degrees[0] << "(c, t);\n";
+        }
+        else {
+            o << "    switch (" << name << "_degree[i]) {\n";
+            for (auto N : degrees) {
+                o << "        case " << N << ": return " << name << "_clenshaw_" << N << "(c, t);\n";
+            }
+            o << "    }\n    return NAN;\n";
+        }
+        o << "}\n";
+        return o.str();
+    }
+
+    HermiteTable HermiteTable::factory(const ChebyshevCollection &cc, int degree, double tol, std::size_t max_cells) {
+        if (degree != 3 && degree != 5) {
+            throw std::invalid_argument("The degree of a HermiteTable must be 3 or 5, not " + std::to_string(degree));
+        }
+        if (!(tol > 0)) {
+            throw std::invalid_argument("The tolerance must be positive");
+        }
+        const auto &exps = cc.get_exps();
+        const double xmin = exps.front().xmin(), xmax = exps.back().xmax();
+        // The derivatives of the collection, once
+        ChebyshevCollection::Container d1, d2;
+        for (const auto &ex : exps) {
+            d1.push_back(ex.deriv(1));
+            if (degree == 5) { d2.push_back(ex.deriv(2)); }
+        }
+        const ChebyshevCollection dcc1(d1), dcc2((degree == 5) ? d2 : d1);
+        const std::size_t Ncoef = static_cast<std::size_t>(degree) + 1;
+        const double tcheck[] = { 0.25, 0.5, 0.75 };
+
+        std::size_t Ncells = std::min<std::size_t>(64, max_cells);
+        while (true) {
+            const double h = (xmax - xmin)/static_cast<double>(Ncells);
+            Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(Ncells + 1, 0, static_cast<double>(Ncells))*h + xmin;
+            x(Ncells) = xmax;
+            const Eigen::ArrayXd f = cc(x), m = dcc1(x)*h;
+            const Eigen::ArrayXd s = (degree == 5) ? Eigen::ArrayXd(dcc2(x)*(h*h)) : Eigen::ArrayXd();
+            std::vector<double> coef(Ncells*Ncoef);
+            for (std::size_t i = 0; i < Ncells; ++i) {
+                double *a = coef.data() + i*Ncoef;
+                const double p0 = f(i), p1 = f(i + 1), m0 = m(i), m1 = m(i + 1), dp = p1 - p0;
+                a[0] = p0; a[1] = m0;
+                if (degree == 3) {
+                    a[2] = 3*dp - 2*m0 - m1;
+                    a[3] = -2*dp + m0 + m1;
+                }
+                else {
+                    const double s0 = s(i), s1 = s(i + 1);
+                    a[2] = s0/2;
+                    a[3] = 10*dp - 6*m0 - 4*m1 - (3*s0 - s1)/2;
+                    a[4] = -15*dp + 8*m0 + 7*m1 + (3*s0 - 2*s1)/2;
+                    a[5] = 6*dp - 3*m0 - 3*m1 - (s0 - s1)/2;
+                }
+            }
+            HermiteTable table(xmin, xmax, degree, Ncells, std::move(coef), 0.0);
+            // Check against the collection inside each cell
+            double err = 0;
+            for (double t : tcheck) {
+                Eigen::ArrayXd xc = (Eigen::ArrayXd::LinSpaced(Ncells, 0, static_cast<double>(Ncells - 1)) + t)*h + xmin;
+                err = std::max(err, (table(xc) - cc(xc)).abs().maxCoeff());
+            }
+            table.m_verified_error = err;
+            if (err <= tol) {
+                return table;
+            }
+            if (Ncells == max_cells) {
+                throw std::invalid_argument("The tolerance of " + std::to_string(tol) + " cannot be met with " + std::to_string(max_cells) + " cells; the error is " + std::to_string(err));
+            }
+            // The error goes as h^(degree+1); aim a little beyond the tolerance
+            const double ratio = std::pow(1.2*err/tol, 1.0/static_cast<double>(degree + 1));
+            const double Nnew = std::ceil(static_cast<double>(Ncells)*std::max(ratio, 1.25));
+            Ncells = (Nnew >= static_cast<double>(max_cells)) ? max_cells : static_cast<std::size_t>(Nnew);
+        }
+    }
+    Eigen::ArrayXd HermiteTable::operator()(const Eigen::Ref<const Eigen::ArrayXd> &x) const {
+        Eigen::ArrayXd y(x.size());
+        for (Eigen::Index j = 0; j < x.size(); ++j) {
+            y(j) = (*this)(x(j));
+        }
+        return y;
+    }
+
+    OnlineChebyshevFitter::OnlineChebyshevFitter(std::size_t N, double xmin, double xmax, double forgetting)
+        : m_N(N), m_xmin(xmin), m_xmax(xmax), m_forgetting(forgetting) {
+        if (!(forgetting > 0 && forgetting <= 1)) {
+            throw std::invalid_argument("forgetting factor [" + std::to_string(forgetting) + "] must be in (0, 1]");
+        }
+        if (xmax <= xmin) {
+            throw std::invalid_argument("xmax must be greater than xmin");
+        }
+        m_row.resize(N + 1);
+        reset();
+    }
+    void OnlineChebyshevFitter::reset() {
+        m_R = Eigen::MatrixXd::Zero(m_N + 1, m_N + 1);
+        m_z = Eigen::VectorXd::Zero(m_N + 1);
+        m_Nsamples = 0;
+    }
+    void OnlineChebyshevFitter::add_sample(double x, double y, double weight) {
+        if (m_forgetting != 1) {
+            double scale = sqrt(m_forgetting);
+            m_R.triangularView<Eigen::Upper>() *= scale;
+            m_z *= scale;
+        }
+        // The new row of the least-squares problem: sqrt(w)*[T_0(x), T_1(x), ..., T_N(x)], and sqrt(w)*y on the right
+        const double xscaled = (2*x - (m_xmax + m_xmin))/(m_xmax - m_xmin), sqrtw = sqrt(weight);
+        Eigen::VectorXd& r = m_row;
+        r(0) = sqrtw;
+        if (m_N > 0) { r(1) = sqrtw*xscaled; }
+        for (std::size_t n = 1; n < m_N; ++n) {
+            r(n + 1) = 2*xscaled*r(n) - r(n - 1);
+        }
+        double rho = sqrtw*y;
+
+        // Rotate the new row into R, one column at a time
+        for (Eigen::Index k = 0; k <= static_cast<Eigen::Index>(m_N); ++k) {
+            if (r(k) == 0) { continue; }
+            const double h = std::hypot(m_R(k, k), r(k)), c = m_R(k, k)/h, s = r(k)/h;
+            for (Eigen::Index j = k; j <= static_cast<Eigen::Index>(m_N); ++j) {
+                const double Rkj = m_R(k, j);
+                m_R(k, j) = c*Rkj + s*r(j);
+                r(j) = -s*Rkj + c*r(j);
+            }
+            const double zk = m_z(k);
+            m_z(k) = c*zk + s*rho;
+            rho = -s*zk + c*rho;
+        }
+        m_Nsamples++;
+    }
+    void OnlineChebyshevFitter::add_samples(const Eigen::VectorXd &x, const Eigen::VectorXd &y) {
+        if (x.size() != y.size()) {
+            throw std::invalid_argument("x and y must be the same size");
+        }
+        for (Eigen::Index i = 0; i < x.size(); ++i) {
+            add_sample(x(i), y(i));
+        }
+    }
+    ChebyshevExpansion OnlineChebyshevFitter::get_expansion() const {
+        const double Rmax = m_R.diagonal().cwiseAbs().maxCoeff();
+        if (!(m_R.diagonal().cwiseAbs().minCoeff() > 1e-14*Rmax)) {
+            throw std::invalid_argument("The " + std::to_string(m_Nsamples) + " samples do not determine an expansion of degree " + std::to_string(m_N));
+        }
+        return ChebyshevExpansion(m_R.triangularView<Eigen::Upper>().solve(m_z), m_xmin, m_xmax);
+    }
+
+    /// Rows of the tall matrix Q (with orthonormal columns) that give a submatrix of nearly maximal volume, as in Goreinov et al., 2010
+    static std::vector<Eigen::Index> maxvol(const Eigen::MatrixXd &Q) {
+        const Eigen::Index r = Q.cols();
+        // The pivots of the LU decomposition make a good start
+        Eigen::FullPivLU<Eigen::MatrixXd> lu(Q);
+        const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> Pinv = lu.permutationP().inverse();
+        std::vector<Eigen::Index> rows(r);
+        for (Eigen::Index i = 0; i < r; ++i) { rows[i] = Pinv.indices()(i); }
+        Eigen::MatrixXd S(r, r);
+        for (int iter = 0; iter < 100; ++iter) {
+            for (Eigen::Index i = 0; i < r; ++i) { S.row(i) = Q.row(rows[i]); }
+            // The coefficients of all the rows in terms of the chosen ones; a coefficient greater than one in magnitude
+            // means that swapping that row in increases the volume
+            const Eigen::MatrixXd B = S.transpose().partialPivLu().solve(Q.transpose()).transpose();
+            Eigen::Index i, j;
+            if (B.cwiseAbs().maxCoeff(&i, &j) <= 1.01) { break; }
+            rows[j] = i;
+        }
+        return rows;
+    }
+    /// The columns of the thin Q factor of A
+    static Eigen::MatrixXd thin_Q(const Eigen::MatrixXd &A) {
+        return Eigen::HouseholderQR<Eigen::MatrixXd>(A).householderQ()*Eigen::MatrixXd::Identity(A.rows(), std::min(A.rows(), A.cols()));
+    }
+    /// Core k, held as an \f$(r_{k-1}r_k)\times n\f$ matrix, as a tensor of size \f$r_{k-1}\times n\times r_k\f$ with the first index the fastest
+    static Eigen::VectorXd core_to_tensor(const Eigen::MatrixXd &core, Eigen::Index r0, Eigen::Index r1) {
+        const Eigen::Index n = core.cols();
+        Eigen::VectorXd t(r0*n*r1);
+        for (Eigen::Index b = 0; b < r1; ++b) {
+            for (Eigen::Index j = 0; j < n; ++j) {
+                t.segment(r0*(j + n*b), r0) = core.col(j).segment(r0*b, r0);
+            }
+        }
+        return t;
+    }
+    /// The inverse of core_to_tensor
+    static Eigen::MatrixXd tensor_to_core(const Eigen::VectorXd &t, Eigen::Index r0, Eigen::Index n, Eigen::Index r1) {
+        Eigen::MatrixXd core(r0*r1, n);
+        for (Eigen::Index b = 0; b < r1; ++b) {
+            for (Eigen::Index j = 0; j < n; ++j) {
+                core.col(j).segment(r0*b, r0) = t.segment(r0*(j + n*b), r0);
+            }
+        }
+        return core;
+    }
+    /**
+    * @brief TT-rounding of a train of cores in tensor layout: orthogonalization from the right, then truncated SVDs from the left
+    *
+    * The error in the Frobenius norm is at most tol times the norm of the whole tensor (Oseledets, SIAM J. Sci. Comput., 2011)
+    */
+    static void round_tensor_train(std::vector<Eigen::VectorXd> &T, std::vector<Eigen::Index> &r, const std::vector<Eigen::Index> &n, double tol) {
+        const std::size_t d = T.size();
+        for (std::size_t k = d - 1; k >= 1; --k) {
+            const Eigen::Map<const Eigen::MatrixXd> right(T[k].data(), r[k], n[k]*r[k + 1]);
+            Eigen::HouseholderQR<Eigen::MatrixXd> qr(right.transpose());
+            const Eigen::Index rnew = std::min(r[k], n[k]*r[k + 1]);
+            const Eigen::MatrixXd Q = qr.householderQ()*Eigen::MatrixXd::Identity(n[k]*r[k + 1], rnew);
+            const Eigen::MatrixXd R = qr.matrixQR().topRows(rnew).triangularView<Eigen::Upper>();
+            const Eigen::Map<const Eigen::MatrixXd> left(T[k - 1].data(), r[k - 1]*n[k - 1], r[k]);
+            const Eigen::MatrixXd newleft = left*R.transpose();
+            T[k] = Eigen::Map<const Eigen::VectorXd>(Eigen::MatrixXd(Q.transpose()).data(), rnew*n[k]*r[k + 1]);
+            T[k - 1] = Eigen::Map<const Eigen::VectorXd>(newleft.data(), newleft.size());
+            r[k] = rnew;
+        }
+        const double delta2 = std::pow(tol*T[0].norm(), 2)/std::max<double>(1, static_cast<double>(d) - 1);
+        for (std::size_t k = 0; k + 1 < d; ++k) {
+            const Eigen::Map<const Eigen::MatrixXd> left(T[k].data(), r[k]*n[k], r[k + 1]);
+            Eigen::BDCSVD<Eigen::MatrixXd> svd(left, Eigen::ComputeThinU | Eigen::ComputeThinV);
+            const Eigen::VectorXd &s = svd.singularValues();
+            Eigen::Index rr = s.size();
+            double tail = 0;
+            while (rr > 1 && tail + s(rr - 1)*s(rr - 1) <= delta2) { tail += s(rr - 1)*s(rr - 1); --rr; }
+            const Eigen::MatrixXd U = svd.matrixU().leftCols(rr);
+            const Eigen::MatrixXd SVt = s.head(rr).asDiagonal()*svd.matrixV().leftCols(rr).transpose();
+            const Eigen::Map<const Eigen::MatrixXd> right(T[k + 1].data(), r[k + 1], n[k + 1]*r[k + 2]);
+            const Eigen::MatrixXd newright = SVt*right;
+            T[k] = Eigen::Map<const Eigen::VectorXd>(U.data(), U.size());
+            T[k + 1] = Eigen::Map<const Eigen::VectorXd>(newright.data(), newright.size());
+            r[k + 1] = rr;
+        }
+    }
+
+    ChebyshevTensorTrain::ChebyshevTensorTrain(const std::vector<Eigen::MatrixXd> &cores, const std::vector<Eigen::Index> &ranks, const Eigen::ArrayXd &xmin, const Eigen::ArrayXd &xmax)
+        : m_cores(cores), m_ranks(ranks), m_xmin(xmin), m_xmax(xmax) {
+        const std::size_t d = cores.size();
+        if (d == 0) {
+            throw std::invalid_argument("At least one core is needed");
+        }
+        if (ranks.size() != d + 1 || ranks.front() != 1 || ranks.back() != 1) {
+            throw std::invalid_argument("There must be d+1 ranks, the first and last equal to 1");
+        }
+        if (static_cast<std::size_t>(xmin.size()) != d || static_cast<std::size_t>(xmax.size()) != d) {
+            throw std::invalid_argument("There must be one xmin and one xmax for each of the " + std::to_string(d) + " variables");
+        }
+        for (std::size_t k = 0; k < d; ++k) {
+            if (cores[k].rows() != ranks[k]*ranks[k + 1] || cores[k].cols() < 1) {
+                throw std::invalid_argument("Core " + std::to_string(k) + " must have r_{k-1}*r_k rows and at least one column");
+            }
+        }
+    }
+    std::vector<std::size_t> ChebyshevTensorTrain::degrees() const {
+        std::vector<std::size_t> o;
+        for (const auto &core : m_cores) { o.push_back(static_cast<std::size_t>(core.cols() - 1)); }
+        return o;
+    }
+    Eigen::Index ChebyshevTensorTrain::storage_size() const {
+        Eigen::Index n = 0;
+        for (const auto &core : m_cores) { n += core.size(); }
+        return n;
+    }
+    double ChebyshevTensorTrain::y(const Eigen::Ref<const Eigen::VectorXd> &x) const {
+        if (static_cast<std::size_t>(x.size()) != dim()) {
+            throw std::invalid_argument("The point must have " + std::to_string(dim()) + " variables");
+        }
+        Eigen::RowVectorXd v = Eigen::RowVectorXd::Ones(1);
+        Eigen::VectorXd u_k, u_kp1, u_kp2;
+        for (std::size_t k = 0; k < dim(); ++k) {
+            const Eigen::MatrixXd &c = m_cores[k];
+            const Eigen::Index N = c.cols() - 1;
+            const double xs = (2*x(k) - (m_xmax(k) + m_xmin(k)))/(m_xmax(k) - m_xmin(k));
+            // Clenshaw's recurrence with the matrices G_k[j] (as vectors) for coefficients
+            u_kp1 = c.col(N); u_kp2.setZero(c.rows());
+            for (Eigen::Index j = N - 1; j >= 1; --j) {
+                u_k = 2*xs*u_kp1 - u_kp2 + c.col(j);
+                u_kp2.swap(u_kp1); u_kp1.swap(u_k);
+            }
+            const Eigen::VectorXd G = (N == 0) ? c.col(0) : Eigen::VectorXd(c.col(0) + xs*u_kp1 - u_kp2);
+            v = v*Eigen::Map<const Eigen::MatrixXd>(G.data(), m_ranks[k], m_ranks[k + 1]);
+        }
+        return v(0);
+    }
+    Eigen::ArrayXd ChebyshevTensorTrain::y_batch(const Eigen::Ref<const Eigen::ArrayXXd> &X, int Nthreads) const {
+        if (static_cast<std::size_t>(X.cols()) != dim()) {
+            throw std::invalid_argument("The points must have " + std::to_string(dim()) + " columns");
+        }
+        const Eigen::Index npts = X.rows(), Nblocks = (npts + batch_block_size - 1)/batch_block_size;
+        Eigen::ArrayXd out(npts);
+        parallel_for(static_cast<long>(Nblocks), Nthreads, [&](long iblock) {
+            const Eigen::Index istart = iblock*batch_block_size, nb = std::min(batch_block_size, npts - istart);
+            // Row p of V is the product of the modes so far at point p
+            Eigen::ArrayXXd V = Eigen::ArrayXXd::Ones(nb, 1), Vnew, u_k, u_kp1, u_kp2, G;
+            for (std::size_t k = 0; k < dim(); ++k) {
+                const Eigen::MatrixXd &c = m_cores[k];
+                const Eigen::Index N = c.cols() - 1, r0 = m_ranks[k], r1 = m_ranks[k + 1];
+                const Eigen::RowVectorXd xs = ((2*X.col(k).segment(istart, nb) - (m_xmax(k) + m_xmin(k)))/(m_xmax(k) - m_xmin(k))).matrix().transpose();
+                // Clenshaw's recurrence for all the points of the block together; column p is for point p
+                u_kp1 = c.col(N).array().replicate(1, nb); u_kp2.setZero(c.rows(), nb);
+                for (Eigen::Index j = N - 1; j >= 1; --j) {
+                    u_k = (u_kp1.rowwise()*(2*xs.array())) - u_kp2;
+                    u_k.colwise() += c.col(j).array();
+                    u_kp2.swap(u_kp1); u_kp1.swap(u_k);
+                }
+                if (N == 0) { G = c.col(0).array().replicate(1, nb); }
+                else { G = (u_kp1.rowwise()*xs.array()) - u_kp2; G.colwise() += c.col(0).array(); }
+                Vnew.setZero(nb, r1);
+                for (Eigen::Index b = 0; b < r1; ++b) {
+                    for (Eigen::Index a = 0; a < r0; ++a) {
+                        Vnew.col(b) += V.col(a)*G.row(a + r0*b).transpose();
+                    }
+                }
+                V.swap(Vnew);
+            }
+            out.segment(istart, nb) = V.col(0);
+        });
+        return out;
+    }
+    void ChebyshevTensorTrain::round(double tol) {
+        const std::size_t d = dim();
+        std::vector<Eigen::VectorXd> T(d);
+        std::vector<Eigen::Index> n(d);
+        for (std::size_t k = 0; k < d; ++k) {
+            n[k] = m_cores[k].cols();
+            T[k] = core_to_tensor(m_cores[k], m_ranks[k], m_ranks[k + 1]);
+        }
+        round_tensor_train(T, m_ranks, n, tol);
+        for (std::size_t k = 0; k < d; ++k) {
+            m_cores[k] = tensor_to_core(T[k], m_ranks[k], n[k], m_ranks[k + 1]);
+        }
+    }
+
+    ChebyshevTensorTrain ChebyshevTensorTrain::factory(const std::vector<std::size_t> &degrees, const Function &func,
+        const Eigen::ArrayXd &xmin, const Eigen::ArrayXd &xmax, double tol, Eigen::Index max_rank) {
+        const std::size_t d = degrees.size();
+        if (d == 0 || static_cast<std::size_t>(xmin.size()) != d || static_cast<std::size_t>(xmax.size()) != d) {
+            throw std::invalid_argument("There must be at least one variable, and one xmin and one xmax for each");
+        }
+        std::vector<Eigen::Index> n(d);
+        std::vector<Eigen::ArrayXd> nodes(d);
+        for (std::size_t k = 0; k < d; ++k) {
+            if (degrees[k] < 1) { throw std::invalid_argument("Degrees must be at least 1"); }
+            n[k] = static_cast<Eigen::Index>(degrees[k]) + 1;
+            nodes[k] = ((xmax(k) - xmin(k))*get_CLnodes(degrees[k]).array() + (xmax(k) + xmin(k)))/2;
+        }
+        using MultiIndex = std::vector<Eigen::Index>;
+        Eigen::VectorXd point(d);
+        // The function at the grid point given by the indices of the left set, i in mode k, and the indices of the right set
+        auto f = [&](const MultiIndex &left, Eigen::Index i, const MultiIndex &right) {
+            const std::size_t k = left.size();
+            for (std::size_t j = 0; j < k; ++j) { point(j) = nodes[j](left[j]); }
+            point(k) = nodes[k](i);
+            for (std::size_t j = 0; j < right.size(); ++j) { point(k + 1 + j) = nodes[k + 1 + j](right[j]); }
+            return func(point);
+        };
+        auto concat = [](const MultiIndex &a, Eigen::Index i, const MultiIndex &b) {
+            MultiIndex o(a); o.push_back(i); o.insert(o.end(), b.begin(), b.end()); return o;
+        };
+
+        // Random validation points in the domain, the same for every rank
+        std::mt19937 gen(1234);
+        std::uniform_real_distribution<double> unif(0, 1);
+        const Eigen::Index Nvalidation = 64;
+        Eigen::MatrixXd Xv(Nvalidation, d);
+        Eigen::VectorXd fv(Nvalidation);
+        for (Eigen::Index p = 0; p < Nvalidation; ++p) {
+            for (std::size_t k = 0; k < d; ++k) { Xv(p, k) = xmin(k) + (xmax(k) - xmin(k))*unif(gen); }
+            fv(p) = func(Xv.row(p).transpose());
+        }
+        const double scale = std::max(fv.cwiseAbs().maxCoeff(), std::numeric_limits<double>::min());
+
+        // Take the nodal cores to coefficients mode by mode, round, and wrap
+        auto assemble = [&](const std::vector<Eigen::VectorXd> &nodal, const std::vector<Eigen::Index> &ranks, double round_tol) {
+            std::vector<Eigen::VectorXd> T(nodal);
+            std::vector<Eigen::Index> r(ranks);
+            for (std::size_t k = 0; k < d; ++k) {
+                const Eigen::MatrixXd &L = l_matrix_library.get(degrees[k]);
+                for (Eigen::Index b = 0; b < r[k + 1]; ++b) {
+                    Eigen::Map<Eigen::MatrixXd> slice(T[k].data() + r[k]*n[k]*b, r[k], n[k]);
+                    slice = Eigen::MatrixXd(slice*L.transpose());
+                }
+            }
+            if (round_tol > 0) { round_tensor_train(T, r, n, round_tol); }
+            std::vector<Eigen::MatrixXd> cores(d);
+            for (std::size_t k = 0; k < d; ++k) { cores[k] = tensor_to_core(T[k], r[k], n[k], r[k + 1]); }
+            ChebyshevTensorTrain tt(cores, r, xmin, xmax);
+            tt.m_estimated_error = (tt.y_batch(Xv.array()) - fv.array()).abs().maxCoeff();
+            return tt;
+        };
+
+        std::unique_ptr<ChebyshevTensorTrain> best;
+        for (Eigen::Index R = 2; ; R = std::min(2*R, max_rank)) {
+            // Ranks as requested, but no more than the sizes of the unfoldings
+            std::vector<Eigen::Index> r(d + 1, 1);
+            double pleft = 1;
+            for (std::size_t k = 1; k < d; ++k) {
+                pleft *= static_cast<double>(n[k - 1]);
+                double pright = 1;
+                for (std::size_t j = k; j < d; ++j) { pright *= static_cast<double>(n[j]); }
+                r[k] = static_cast<Eigen::Index>(std::min<double>({ static_cast<double>(R), pleft, pright }));
+            }
+            // Random right index sets to start
+            std::vector<std::vector<MultiIndex>> left(d + 1), right(d + 1);
+            left[0] = { MultiIndex() }; right[d] = { MultiIndex() };
+            for (std::size_t k = 1; k < d; ++k) {
+                std::set<MultiIndex> chosen;
+                while (static_cast<Eigen::Index>(chosen.size()) < r[k]) {
+                    MultiIndex idx;
+                    for (std::size_t j = k; j < d; ++j) { idx.push_back(static_cast<Eigen::Index>(unif(gen)*n[j]) % n[j]); }
+                    chosen.insert(idx);
+                }
+                right[k].assign(chosen.begin(), chosen.end());
+            }
+            std::vector<Eigen::VectorXd> nodal(d);
+            double previous = std::numeric_limits<double>::infinity();
+            std::unique_ptr<ChebyshevTensorTrain> best_for_rank;
+            for (int sweep = 0; sweep < 4; ++sweep) {
+                if (sweep % 2 == 0) {
+                    // Left to right: new left index sets, interpolating cores, and the last core of values
+                    for (std::size_t k = 0; k + 1 < d; ++k) {
+                        Eigen::MatrixXd A(r[k]*n[k], r[k + 1]);
+                        for (Eigen::Index b = 0; b < r[k + 1]; ++b) {
+                            for (Eigen::Index i = 0; i < n[k]; ++i) {
+                                for (Eigen::Index a = 0; a < r[k]; ++a) { A(a + r[k]*i, b) = f(left[k][a], i, right[k + 1][b]); }
+                            }
+                        }
+                        const Eigen::MatrixXd Q = thin_Q(A);
+                        const auto rows = maxvol(Q);
+                        left[k + 1].clear();
+                        Eigen::MatrixXd S(r[k + 1], r[k + 1]);
+                        for (Eigen::Index j = 0; j < r[k + 1]; ++j) {
+                            left[k + 1].push_back(concat(left[k][rows[j] % r[k]], rows[j]/r[k], MultiIndex()));
+                            S.row(j) = Q.row(rows[j]);
+                        }
+                        const Eigen::MatrixXd G = S.transpose().partialPivLu().solve(Q.transpose()).transpose();
+                        nodal[k] = Eigen::Map<const Eigen::VectorXd>(G.data(), G.size());
+                    }
+                    const std::size_t k = d - 1;
+                    nodal[k].resize(r[k]*n[k]);
+                    for (Eigen::Index i = 0; i < n[k]; ++i) {
+                        for (Eigen::Index a = 0; a < r[k]; ++a) { nodal[k](a + r[k]*i) = f(left[k][a], i, MultiIndex()); }
+                    }
+                }
+                else {
+                    // Right to left: new right index sets, interpolating cores, and the first core of values
+                    for (std::size_t k = d - 1; k >= 1; --k) {
+                        Eigen::MatrixXd Bt(n[k]*r[k + 1], r[k]);
+                        for (Eigen::Index b = 0; b < r[k + 1]; ++b) {
+                            for (Eigen::Index i = 0; i < n[k]; ++i) {
+                                for (Eigen::Index a = 0; a < r[k]; ++a) { Bt(i + n[k]*b, a) = f(left[k][a], i, right[k + 1][b]); }
+                            }
+                        }
+                        const Eigen::MatrixXd Q = thin_Q(Bt);
+                        const auto cols = maxvol(Q);
+                        right[k].clear();
+                        Eigen::MatrixXd S(r[k], r[k]);
+                        for (Eigen::Index j = 0; j < r[k]; ++j) {
+                            right[k].push_back(concat(MultiIndex(), cols[j] % n[k], right[k + 1][cols[j]/n[k]]));
+                            S.row(j) = Q.row(cols[j]);
+                        }
+                        // G is r_k x (n_k r_{k+1}), whose memory is that of the tensor layout
+                        const Eigen::MatrixXd G = S.transpose().partialPivLu().solve(Q.transpose());
+                        nodal[k] = Eigen::Map<const Eigen::VectorXd>(G.data(), G.size());
+                    }
+                    nodal[0].resize(n[0]*r[1]);
+                    for (Eigen::Index b = 0; b < r[1]; ++b) {
+                        for (Eigen::Index i = 0; i < n[0]; ++i) { nodal[0](i + n[0]*b) = f(MultiIndex(), i, right[1][b]); }
+                    }
+                }
+                auto tt = std::make_unique<ChebyshevTensorTrain>(assemble(nodal, r, 0.0));
+                const double err = tt->estimated_error();
+                const bool improved = !best_for_rank || err < best_for_rank->estimated_error();
+                if (improved) { best_for_rank = std::move(tt); }
+                if (err <= tol*scale || err > 0.5*previous) { break; }
+                previous = err;
+            }
+            const bool rank_helped = !best || best_for_rank->estimated_error() < 0.5*best->estimated_error();
+            if (!best || best_for_rank->estimated_error() < best->estimated_error()) { best = std::move(best_for_rank); }
+            if (best->estimated_error() <= tol*scale || !rank_helped || R >= max_rank) { break; }
+        }
+        // Round away the excess rank; the error at the validation points is updated
+        const double err_before = best->estimated_error();
+        ChebyshevTensorTrain rounded = *best;
+        rounded.round(tol);
+        rounded.m_estimated_error = (rounded.y_batch(Xv.array()) - fv.array()).abs().maxCoeff();
+        return (rounded.estimated_error() <= std::max(2*err_before, tol*scale)) ? rounded : *best;
+    }
+
+    namespace ultraspherical {
+
+        SparseMatrix differentiation(Eigen::Index n, int k) {
+            if (k < 0) { throw std::invalid_argument("Order of derivative must be non-negative"); }
+            SparseMatrix D(n, n);
+            if (k == 0) { D.setIdentity(); return D; }
+            // d^k T_j/dx^k = 2^(k-1) (k-1)! j C^(k)_(j-k)
+            double scale = std::pow(2.0, k - 1);
+            for (int i = 2; i < k; ++i) { scale *= i; }
+            std::vector<Eigen::Triplet<double>> triplets;
+            for (Eigen::Index i = 0; i + k < n; ++i) {
+                triplets.emplace_back(i, i + k, scale*static_cast<double>(i + k));
+            }
+            D.setFromTriplets(triplets.begin(), triplets.end());
+            return D;
+        }
+
+        SparseMatrix conversion(Eigen::Index n, int lambda) {
+            if (lambda < 0) { throw std::invalid_argument("lambda must be non-negative"); }
+            std::vector<Eigen::Triplet<double>> triplets;
+            for (Eigen::Index i = 0; i < n; ++i) {
+                if (lambda == 0) {
+                    // T_0 = C^(1)_0, T_j = (C^(1)_j - C^(1)_(j-2))/2
+                    triplets.emplace_back(i, i, (i == 0) ? 1.0 : 0.5);
+                    if (i + 2 < n) { triplets.emplace_back(i, i + 2, -0.5); }
+                }
+                else {
+                    // C^(l)_j = l/(l+j) (C^(l+1)_j - C^(l+1)_(j-2))
+                    triplets.emplace_back(i, i, lambda/static_cast<double>(lambda + i));
+                    if (i + 2 < n) { triplets.emplace_back(i, i + 2, -lambda/static_cast<double>(lambda + i + 2)); }
+                }
+            }
+            SparseMatrix S(n, n);
+            S.setFromTriplets(triplets.begin(), triplets.end());
+            return S;
+        }
+
+        SparseMatrix multiplication(const ChebyshevExpansion &a, Eigen::Index n, int lambda) {
+            if (lambda < 0) { throw std::invalid_argument("lambda must be non-negative"); }
+            const auto c = a.coef_view();
+            const Eigen::Index m = c.size() - 1;
+            // Multiplication by x in the lambda basis, applied to the coefficients v stored from index lo
+            auto times_x = [lambda](const Eigen::VectorXd &v, Eigen::Index lo, Eigen::VectorXd &out) {
+                out.setZero();
+                for (Eigen::Index k = 0; k < v.size(); ++k) {
+                    if (v(k) == 0) { continue; }
+                    const Eigen::Index j = k + lo;
+                    double up, down;
+                    if (lambda == 0) {
+                        up = (j == 0) ? 1.0 : 0.5; down = 0.5;
+                    }
+                    else {
+                        up = (j + 1)/(2.0*(j + lambda)); down = (j + 2*lambda - 1)/(2.0*(j + lambda));
+                    }
+                    if (k + 1 < v.size()) { out(k + 1) += up*v(k); }
+                    if (j > 0 && k > 0) { out(k - 1) += down*v(k); }
+                }
+            };
+            // Column j of a(X) e_j has support in [j-m, j+m]; Clenshaw's method in that window is exact
+            std::vector<Eigen::Triplet<double>> triplets;
+            const Eigen::Index W = 2*m + 3;
+            Eigen::VectorXd e(W), b1(W), b2(W), Xb(W);
+            for (Eigen::Index j = 0; j < n; ++j) {
+                const Eigen::Index lo = std::max<Eigen::Index>(0, j - m - 1);
+                e.setZero(); e(j - lo) = 1;
+                b1.setZero(); b2.setZero();
+                for (Eigen::Index k = m; k >= 1; --k) {
+                    times_x(b1, lo, Xb);
+                    Eigen::VectorXd b0 = c(k)*e + 2*Xb - b2;
+                    b2 = b1; b1 = b0;
+                }
+                times_x(b1, lo, Xb);
+                Eigen::VectorXd col = c(0)*e + Xb - b2;
+                for (Eigen::Index k = 0; k < W && k + lo < n; ++k) {
+                    if (col(k) != 0) { triplets.emplace_back(k + lo, j, col(k)); }
+                }
+            }
+            SparseMatrix M(n, n);
+            M.setFromTriplets(triplets.begin(), triplets.end());
+            return M;
+        }
+
+    } /* namespace ultraspherical */
+
+    /// Solve B*X = Y in place for a square matrix B with lower bandwidth p and upper bandwidth q, with Givens rotations
+    static void banded_QR_solve(const Eigen::SparseMatrix<double, Eigen::RowMajor> &B, Eigen::Index p, Eigen::Index q, Eigen::MatrixXd &Y) {
+        const Eigen::Index n = B.rows(), w = 2*p + q + 1;
+        // Row i holds the columns i-p to i+p+q, the upper bandwidth of R being p+q
+        Eigen::MatrixXd band = Eigen::MatrixXd::Zero(n, w);
+        auto at = [&band, p](Eigen::Index i, Eigen::Index j) -> double& { return band(i, j - i + p); };
+        for (Eigen::Index i = 0; i < n; ++i) {
+            for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(B, i); it; ++it) {
+                at(i, it.col()) = it.value();
+            }
+        }
+        for (Eigen::Index j = 0; j < n; ++j) {
+            const Eigen::Index jmax = std::min(n - 1, j + p + q);
+            for (Eigen::Index i = j + 1; i <= std::min(n - 1, j + p); ++i) {
+                const double bij = at(i, j);
+                if (bij == 0) { continue; }
+                const double h = std::hypot(at(j, j), bij), c = at(j, j)/h, s = bij/h;
+                for (Eigen::Index k = j; k <= jmax; ++k) {
+                    const double rjk = at(j, k), rik = at(i, k);
+                    at(j, k) = c*rjk + s*rik;
+                    at(i, k) = -s*rjk + c*rik;
+                }
+                const Eigen::RowVectorXd yj = Y.row(j);
+                Y.row(j) = c*yj + s*Y.row(i);
+                Y.row(i) = -s*yj + c*Y.row(i);
+            }
+        }
+        for (Eigen::Index j = n - 1; j >= 0; --j) {
+            if (at(j, j) == 0) {
+                throw std::invalid_argument("Banded part of the operator is singular");
+            }
+            for (Eigen::Index k = j + 1; k <= std::min(n - 1, j + p + q); ++k) {
+                Y.row(j) -= at(j, k)*Y.row(k);
+            }
+            Y.row(j) /= at(j, j);
+        }
+    }
+
+    ChebyshevExpansion solve_linear_BVP(const std::vector<ChebyshevExpansion> &a, const ChebyshevExpansion &f, const std::vector<BoundaryCondition> &bcs, std::size_t N) {
+        using namespace ultraspherical;
+        if (a.empty()) { throw std::invalid_argument("At least one coefficient of the equation is required"); }
+        const int K = static_cast<int>(a.size()) - 1;
+        if (static_cast<int>(bcs.size()) != K) {
+            throw std::invalid_argument("Number of boundary conditions [" + std::to_string(bcs.size()) + "] must equal the order of the equation [" + std::to_string(K) + "]");
+        }
+        if (static_cast<int>(N) < K) { throw std::invalid_argument("Degree must be at least the order of the equation"); }
+        const double xmin = f.xmin(), xmax = f.xmax();
+        for (auto &ak : a) {
+            if (ak.xmin() != xmin || ak.xmax() != xmax) { throw std::invalid_argument("Coefficients must have the same domain as f"); }
+        }
+        // The rows of the products are exact for the N+1-K rows that are retained when the operators are built with 2K extra rows
+        const Eigen::Index n = N + 1 + 2*K, Nu = N + 1;
+        std::vector<SparseMatrix> S; // S[k] converts from the k basis to the K basis
+        S.resize(K + 1);
+        S[K].resize(n, n); S[K].setIdentity();
+        for (int k = K - 1; k >= 0; --k) { S[k] = S[k + 1]*conversion(n, k); }
+
+        const double dtdx = 2/(xmax - xmin);
+        SparseMatrix L(n, n);
+        for (int k = 0; k <= K; ++k) {
+            SparseMatrix term = S[k]*multiplication(a[k], n, k)*differentiation(n, k);
+            L += std::pow(dtdx, k)*term;
+        }
+        const Eigen::Index nB = Nu - K;
+        Eigen::VectorXd fc = Eigen::VectorXd::Zero(n);
+        const auto fcoef = f.coef_view();
+        fc.head(std::min<Eigen::Index>(n, fcoef.size())) = fcoef.head(std::min<Eigen::Index>(n, fcoef.size()));
+        Eigen::VectorXd g = (S[0]*fc).head(nB);
+
+        // Boundary rows: sum_d w_d d^dT_j/dx^d at x, from T_(j+1)^(d) = 2t T_j^(d) + 2d T_j^(d-1) - T_(j-1)^(d)
+        Eigen::MatrixXd C = Eigen::MatrixXd::Zero(K, Nu);
+        Eigen::VectorXd cvals(K);
+        for (int r = 0; r < K; ++r) {
+            const auto &bc = bcs[r];
+            const double t = (2*bc.x - (xmax + xmin))/(xmax - xmin);
+            Eigen::VectorXd Tprev(Nu), Td(Nu);
+            for (std::size_t d = 0; d < bc.weights.size(); ++d) {
+                Td.setZero();
+                if (d == 0) { Td(0) = 1; if (Nu > 1) { Td(1) = t; } }
+                else if (Nu > 1) { Td(1) = (d == 1) ? 1 : 0; }
+                for (Eigen::Index j = 1; j + 1 < Nu; ++j) {
+                    Td(j + 1) = 2*t*Td(j) - Td(j - 1) + ((d > 0) ? 2.0*d*Tprev(j) : 0.0);
+                }
+                C.row(r) += bc.weights[d]*std::pow(dtdx, d)*Td.transpose();
+                Tprev = Td;
+            }
+            cvals(r) = bc.value;
+        }
+
+        // Capacitance form: u = [v; w] with B1 v + B2 w = g, and C1 v + C2 w = c
+        Eigen::SparseMatrix<double, Eigen::RowMajor> B = L.topLeftCorner(nB, Nu);
+        Eigen::SparseMatrix<double, Eigen::RowMajor> B2 = B.rightCols(nB);
+        Eigen::Index p = 0, q = 0;
+        for (Eigen::Index i = 0; i < nB; ++i) {
+            for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(B2, i); it; ++it) {
+                p = std::max(p, i - it.col()); q = std::max(q, it.col() - i);
+            }
+        }
+        Eigen::MatrixXd Y(nB, K + 1);
+        Y.leftCols(K) = Eigen::MatrixXd(B.leftCols(K));
+        Y.col(K) = g;
+        banded_QR_solve(B2, p, q, Y);
+        Eigen::VectorXd u(Nu);
+        Eigen::MatrixXd cap = C.leftCols(K) - C.rightCols(nB)*Y.leftCols(K);
+        u.head(K) = cap.fullPivLu().solve(cvals - C.rightCols(nB)*Y.col(K));
+        u.tail(nB) = Y.col(K) - Y.leftCols(K)*u.head(K);
+        return ChebyshevExpansion(u, xmin, xmax);
+    }
+
 }; /* namespace ChebTools */
@@ -5,10 +5,14 @@
 #include <pybind11/stl.h>
 #include <pybind11/operators.h>
 #include <pybind11/eigen.h>
+#include <pybind11/numpy.h>
 #include <pybind11/functional.h>
+#include <pybind11/complex.h>
 
 #include "ChebToolsVersion.hpp"
 
+#include <cstring>
+
 namespace py = pybind11;
 using namespace ChebTools;
 
@@ -58,24 +62,134 @@ auto Clenshaw2DEigen(const MatType& a, double x, double y) {
     return Clenshaw1D(b.matrix(), x);
 }
 
+/// Binary state of an expansion for pickling: the raw coefficients and the domain
+py::tuple expansion_getstate(const ChebyshevExpansion &ce) {
+    const auto c = ce.coef_view();
+    return py::make_tuple(py::bytes(reinterpret_cast<const char *>(c.data()), c.size()*sizeof(double)), ce.xmin(), ce.xmax());
+}
+ChebyshevExpansion expansion_setstate(const py::tuple &t) {
+    if (t.size() != 3) {
+        throw std::runtime_error("Invalid state for ChebyshevExpansion");
+    }
+    // The bytes of a std::string are not guaranteed to be aligned for double, so they are copied out, not mapped
+    const std::string buf = t[0].cast<std::string>();
+    if (buf.empty() || buf.size() % sizeof(double) != 0) {
+        throw std::runtime_error("Invalid state for ChebyshevExpansion");
+    }
+    Eigen::VectorXd c(buf.size()/sizeof(double));
+    std::memcpy(c.data(), buf.data(), buf.size());
+    return ChebyshevExpansion(c, t[1].cast<double>(), t[2].cast<double>());
+}
+
+/// Binary state of a collection for pickling: for each expansion the domain, the number of coefficients and the
+/// coefficients, packed into one buffer, and the degree of the Taylor extrapolation
+py::tuple collection_getstate(const ChebyshevCollection &cc) {
+    std::vector<double> packed;
+    for (const auto &ex : cc.get_exps()) {
+        const auto c = ex.coef_view();
+        packed.push_back(ex.xmin());
+        packed.push_back(ex.xmax());
+        packed.push_back(static_cast<double>(c.size()));
+        packed.insert(packed.end(), c.data(), c.data() + c.size());
+    }
+    return py::make_tuple(py::bytes(reinterpret_cast<const char *>(packed.data()), packed.size()*sizeof(double)), cc.get_Taylor_extrapolation());
+}
+ChebyshevCollection collection_setstate(const py::tuple &t) {
+    if (t.size() != 2) {
+        throw std::runtime_error("Invalid state for ChebyshevCollection");
+    }
+    // Copied into an aligned buffer of doubles, since the bytes of a std::string need not be aligned for double
+    const std::string buf = t[0].cast<std::string>();
+    if (buf.size() % sizeof(double) != 0) {
+        throw std::runtime_error("Invalid state for ChebyshevCollection");
+    }
+    Eigen::VectorXd packed(buf.size()/sizeof(double));
+    std::memcpy(packed.data(), buf.data(), buf.size());
+    ChebyshevCollection::Container exps;
+    Eigen::Index i = 0;
+    while (i + 3 <= packed.size()) {
+        const double xmin = packed(i), xmax = packed(i + 1), Ncoef = packed(i + 2);
+        i += 3;
+        if (!(Ncoef >= 1 && Ncoef <= static_cast<double>(packed.size() - i))) {
+            throw std::runtime_error("Truncated state for ChebyshevCollection");
+        }
+        exps.emplace_back(packed.segment(i, static_cast<Eigen::Index>(Ncoef)), xmin, xmax);
+        i += static_cast<Eigen::Index>(Ncoef);
+    }
+    ChebyshevCollection cc(exps);
+    cc.set_Taylor_extrapolation(t[1].cast<int>());
+    return cc;
+}
+
 void init_ChebTools(py::module &m){
 
     m.def("mult_by", &mult_by);
     m.def("mult_by_inplace", &mult_by_inplace);
     m.def("evaluation_speed_test", &evaluation_speed_test);
     m.def("eigs_speed_test", &eigs_speed_test);
+    m.def("real_roots_speed_test", &real_roots_speed_test);
+    m.def("warmup_latency_test", &warmup_latency_test, py::arg("N"), py::arg("Nrepeats"));
+    m.def("minimize_speed_test", &minimize_speed_test);
+    m.def("Hermite_table_speed_test", &Hermite_table_speed_test, py::arg("tol"), py::arg("Npoints"));
+    m.def("cursor_speed_test", &cursor_speed_test, py::arg("Npieces"), py::arg("Npoints"));
+    m.def("splitting_cost_test", &splitting_cost_test, py::arg("N"), py::arg("tol"));
+    m.def("pencil_speed_test", &pencil_speed_test, py::arg("N"), py::arg("Nshifts"));
     m.def("eigenvalues", &eigenvalues);
     m.def("eigenvalues_upperHessenberg", &eigenvalues_upperHessenberg);
     m.def("factoryfDCT", &ChebyshevExpansion::factoryf); 
     m.def("factoryfFFT", &ChebyshevExpansion::factoryfFFT);
+    m.def("resample_nodal_values", &ChebyshevExpansion::resample_nodal_values);
+    m.def("warmup", &warmup, py::arg("degrees"));
+    m.def("cached_degrees", &cached_degrees);
+    m.def("save_transform_cache", &save_transform_cache, py::arg("path"));
+    m.def("load_transform_cache", &load_transform_cache, py::arg("path"));
     m.def("generate_Chebyshev_expansion", &ChebyshevExpansion::factory<std::function<double(double)> >);
     m.def("dyadic_splitting", &ChebyshevExpansion::dyadic_splitting<std::vector<ChebyshevExpansion>>);
+    m.def("adaptive_splitting", &ChebyshevExpansion::adaptive_splitting<std::vector<ChebyshevExpansion>>, py::arg("N"), py::arg("func"), py::arg("xmin"), py::arg("xmax"), py::arg("M"), py::arg("tol"), py::arg("max_refine_passes") = 8, py::arg("merge") = true, py::arg("callback") = std::function<void(int, const std::vector<ChebyshevExpansion>&)>{});
     m.def("Eigen_nbThreads", []() { return Eigen::nbThreads(); });
     m.def("Eigen_setNbThreads", [](int Nthreads) { return Eigen::setNbThreads(Nthreads); });
     m.def("make_Taylor_extrapolator", &make_Taylor_extrapolator);
+    m.def("evaluate_many", &evaluate_many, py::arg("exps"), py::arg("x"), py::arg("Nthreads") = 1, py::call_guard<py::gil_scoped_release>());
+    m.def("monotonic_solvex_many", &monotonic_solvex_many, py::arg("ce"), py::arg("ys"), py::arg("Nthreads") = 1, py::call_guard<py::gil_scoped_release>());
+    m.def("real_roots_many", [](const std::vector<ChebyshevExpansion> &exps, bool only_in_domain, int Nthreads) {
+        std::vector<std::vector<double>> roots;
+        {
+            py::gil_scoped_release release;
+            roots = real_roots_many(exps, only_in_domain, Nthreads);
+        }
+        py::list out;
+        for (const auto &r : roots) {
+            out.append(py::array_t<double>(r.size(), r.data()));
+        }
+        return out;
+    }, py::arg("exps"), py::arg("only_in_domain") = true, py::arg("Nthreads") = 1);
+
+    py::class_<ValueWithError>(m, "ValueWithError")
+        .def_readonly("value", &ValueWithError::value)
+        .def_readonly("error", &ValueWithError::error)
+        ;
+
+    py::class_<SingularityEstimate>(m, "SingularityEstimate")
+        .def_readonly("z", &SingularityEstimate::z)
+        .def_readonly("rho", &SingularityEstimate::rho)
+        .def_readonly("misfit", &SingularityEstimate::misfit)
+        ;
+
+    py::class_<RangeEnclosure>(m, "RangeEnclosure")
+        .def_readonly("ymin", &RangeEnclosure::ymin)
+        .def_readonly("ymax", &RangeEnclosure::ymax)
+        ;
+
+    py::class_<ValuesWithErrors>(m, "ValuesWithErrors")
+        .def_readonly("values", &ValuesWithErrors::values)
+        .def_readonly("errors", &ValuesWithErrors::errors)
+        ;
 
     py::class_<ChebyshevExpansion>(m, "ChebyshevExpansion")
-        .def(py::init<const std::vector<double> &, double, double>())
+        .def(py::init([](const Eigen::Ref<const Eigen::VectorXd> &c, double xmin, double xmax) { return ChebyshevExpansion(c, xmin, xmax); }),
+             py::arg("c"), py::arg("xmin") = -1.0, py::arg("xmax") = 1.0)
+        .def(py::init<const std::vector<double> &, double, double>(), py::arg("c"), py::arg("xmin") = -1.0, py::arg("xmax") = 1.0)
+        .def(py::pickle(&expansion_getstate, &expansion_setstate))
         .def(py::self + py::self)
         .def(py::self += py::self)
         .def(py::self + double())
@@ -91,17 +205,45 @@ void init_ChebTools(py::module &m){
         .def("times_x_inplace", &ChebyshevExpansion::times_x_inplace)
         .def("apply", &ChebyshevExpansion::apply)
         //.def("__repr__", &Vector2::toString);
-        .def("coef", &ChebyshevExpansion::coef)
+        .def("coef", [](const ChebyshevExpansion &ce) -> Eigen::VectorXd { return ce.coef_view(); })
+        // The view points into the coefficient storage of the expansion, which in-place operations can reallocate
+        // (moving it between the inline buffer and the heap), so the caveat is in the docstring for Python users
+        .def("coef_view", [](py::object self) {
+            const auto c = self.cast<const ChebyshevExpansion&>().coef_view();
+            py::array_t<double> view(c.size(), c.data(), self);
+            view.attr("flags").attr("writeable") = false;
+            return view;
+        }, "Read-only numpy view of the coefficients, without a copy; the view keeps the expansion alive.\n\n"
+           "The view is only valid until the expansion is next modified in place (+=, *=, times_x_inplace, deriv_inplace, ...), "
+           "after which it may point at freed memory; use coef() for a copy that stays valid.")
         .def("companion_matrix", &ChebyshevExpansion::companion_matrix)
         .def("y", (vectype(ChebyshevExpansion::*)(const vectype &) const) &ChebyshevExpansion::y)
         .def("y", (double (ChebyshevExpansion::*)(const double) const) &ChebyshevExpansion::y)
         .def("y_Clenshaw", &ChebyshevExpansion::y_Clenshaw)
+        .def("y_with_error", (ValueWithError(ChebyshevExpansion::*)(const double) const) &ChebyshevExpansion::y_with_error)
+        .def("y_with_error", (ValuesWithErrors(ChebyshevExpansion::*)(const vectype &) const) &ChebyshevExpansion::y_with_error)
+        .def("y_with_error_xscaled", &ChebyshevExpansion::y_with_error_xscaled)
         .def("real_roots", &ChebyshevExpansion::real_roots)
         .def("real_roots_time", &ChebyshevExpansion::real_roots_time)
         .def("real_roots_approx", &ChebyshevExpansion::real_roots_approx)
+        .def("prolong", &ChebyshevExpansion::prolong)
+        .def("truncate_to", &ChebyshevExpansion::truncate_to)
+        .def("restrict", &ChebyshevExpansion::restrict)
+        .def("restrict_batch", &ChebyshevExpansion::restrict_batch, py::arg("breakpoints"), py::arg("Ndegree") = -1)
+        .def("range_enclosure", &ChebyshevExpansion::range_enclosure, py::arg("a"), py::arg("b"), py::arg("max_bisections") = 0)
+        .def("range_enclosure_batch", &ChebyshevExpansion::range_enclosure_batch, py::arg("breakpoints"), py::arg("max_bisections") = 0, py::arg("Nthreads") = 1, py::call_guard<py::gil_scoped_release>())
+        .def("might_take_value", &ChebyshevExpansion::might_take_value)
+        .def("nearest_singularity", &ChebyshevExpansion::nearest_singularity)
+        .def("minimize", (Extremum(ChebyshevExpansion::*)(double, double) const) &ChebyshevExpansion::minimize, py::arg("a"), py::arg("b"))
+        .def("minimize", (Extremum(ChebyshevExpansion::*)() const) &ChebyshevExpansion::minimize)
+        .def("maximize", (Extremum(ChebyshevExpansion::*)(double, double) const) &ChebyshevExpansion::maximize, py::arg("a"), py::arg("b"))
+        .def("maximize", (Extremum(ChebyshevExpansion::*)() const) &ChebyshevExpansion::maximize)
+        .def("argmin", &ChebyshevExpansion::argmin)
+        .def("argmax", &ChebyshevExpansion::argmax)
         .def("subdivide", &ChebyshevExpansion::subdivide)
         .def("real_roots_intervals", &ChebyshevExpansion::real_roots_intervals)
         .def("deriv", &ChebyshevExpansion::deriv)
+        .def("deriv_inplace", &ChebyshevExpansion::deriv_inplace)
         .def("integrate", &ChebyshevExpansion::integrate)
         .def("xmin", &ChebyshevExpansion::xmin)
         .def("xmax", &ChebyshevExpansion::xmax)
@@ -111,14 +253,74 @@ void init_ChebTools(py::module &m){
         .def("monotonic_solvex", &ChebyshevExpansion::monotonic_solvex)
         ;
 
+    py::class_<ColleagueMatrix>(m, "ColleagueMatrix")
+        .def(py::init<const Eigen::Ref<const Eigen::VectorXd>&>())
+        .def("size", &ColleagueMatrix::size)
+        .def("lower", &ColleagueMatrix::lower)
+        .def("upper", &ColleagueMatrix::upper)
+        .def("last_row", &ColleagueMatrix::last_row)
+        .def("balancing", &ColleagueMatrix::balancing)
+        .def("balance", &ColleagueMatrix::balance, py::return_value_policy::reference_internal)
+        .def("dense", &ColleagueMatrix::dense)
+        .def("upper_Hessenberg", &ColleagueMatrix::upper_Hessenberg)
+        .def("eigenvalues", &ColleagueMatrix::eigenvalues)
+        .def("real_eigenvalues", &ColleagueMatrix::real_eigenvalues)
+        .def("__matmul__", [](const ColleagueMatrix &A, const Eigen::VectorXd &v) { return A*v; }, py::is_operator())
+        ;
+    py::class_<ColleaguePencil>(m, "ColleaguePencil")
+        .def(py::init<const ChebyshevExpansion&>())
+        .def("real_roots", py::overload_cast<double, bool>(&ColleaguePencil::real_roots, py::const_), py::arg("c"), py::arg("only_in_domain") = true)
+        .def("real_roots", py::overload_cast<const std::vector<double>&, bool, int>(&ColleaguePencil::real_roots, py::const_), py::arg("cs"), py::arg("only_in_domain") = true, py::arg("Nthreads") = 1, py::call_guard<py::gil_scoped_release>())
+        ;
+    py::class_<Extremum>(m, "Extremum")
+        .def_readonly("x", &Extremum::x)
+        .def_readonly("y", &Extremum::y)
+        ;
+
+    py::class_<MonotonicRange>(m, "MonotonicRange")
+        .def_readonly("xmin", &MonotonicRange::xmin)
+        .def_readonly("xmax", &MonotonicRange::xmax)
+        .def_readonly("increasing", &MonotonicRange::increasing)
+        ;
+
     using Container = ChebyshevCollection::Container;
     py::class_<ChebyshevCollection>(m, "ChebyshevCollection")
         .def(py::init<const Container&>())
         .def("__call__", [](const ChebyshevCollection& c, const double x) { return c(x); }, py::is_operator())
+        .def("__call__", [](const ChebyshevCollection& c, const Eigen::Ref<const Eigen::ArrayXd>& x) { return c(x); }, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def(py::pickle(&collection_getstate, &collection_setstate))
+        .def(py::self + py::self)
+        .def(py::self - py::self)
+        .def(py::self * py::self)
+        .def(py::self / py::self)
+        .def("apply", &ChebyshevCollection::apply)
+        .def("combine", [](const ChebyshevCollection& c, const ChebyshevCollection& other, const py::function& op, int Nthreads) {
+            // The worker threads of combine each need the GIL to call op, so it must not be held by this thread while
+            // it waits for them (a deadlock for Nthreads > 1); it is released for the whole call and taken back only
+            // around each call of op.  The calls of op are thereby serialized, while the C++ work runs in parallel
+            auto op_with_gil = [&op](const ChebyshevExpansion& a, const ChebyshevExpansion& b) {
+                py::gil_scoped_acquire acquire;
+                return op(a, b).cast<ChebyshevExpansion>();
+            };
+            py::gil_scoped_release release;
+            return c.combine(other, op_with_gil, Nthreads);
+        }, py::arg("other"), py::arg("op"), py::arg("Nthreads") = 1)
+        .def("get_breakpoints", &ChebyshevCollection::get_breakpoints)
+        .def("set_Taylor_extrapolation", &ChebyshevCollection::set_Taylor_extrapolation)
+        .def("is_extrapolating", &ChebyshevCollection::is_extrapolating)
+        .def("get_Taylor_extrapolation", &ChebyshevCollection::get_Taylor_extrapolation)
         .def("integrate", &ChebyshevCollection::integrate)
         .def("get_exps", &ChebyshevCollection::get_exps)
         .def("get_extrema", &ChebyshevCollection::get_extrema)
-        .def("solve_for_x", &ChebyshevCollection::solve_for_x)
+        .def("get_extrema_points", &ChebyshevCollection::get_extrema_points)
+        .def("get_monotonic_ranges", &ChebyshevCollection::get_monotonic_ranges)
+        .def("global_min", &ChebyshevCollection::global_min)
+        .def("global_max", &ChebyshevCollection::global_max)
+        .def("max_on", &ChebyshevCollection::max_on)
+        .def("min_on", &ChebyshevCollection::min_on)
+        .def("get_galloping_index", &ChebyshevCollection::get_galloping_index, py::arg("x"), py::arg("hint"))
+        .def("solve_for_x", [](const ChebyshevCollection& c, double y) { return c.solve_for_x(y); }, py::arg("y"))
+        .def("solve_for_x", [](const ChebyshevCollection& c, const std::vector<double>& ys) { return c.solve_for_x(ys); }, py::arg("ys"))
         .def("make_inverse", &ChebyshevCollection::make_inverse)
         .def("get_hinted_index", &ChebyshevCollection::get_hinted_index)
         ;
@@ -130,6 +332,61 @@ void init_ChebTools(py::module &m){
         .def("get_coef", &TaylorExtrapolator<Eigen::ArrayXd>::get_coef)
         ;
 
+    py::class_<OnlineChebyshevFitter>(m, "OnlineChebyshevFitter")
+        .def(py::init<std::size_t, double, double, double>(), py::arg("N"), py::arg("xmin"), py::arg("xmax"), py::arg("forgetting") = 1.0)
+        .def("add_sample", &OnlineChebyshevFitter::add_sample, py::arg("x"), py::arg("y"), py::arg("weight") = 1.0)
+        .def("add_samples", &OnlineChebyshevFitter::add_samples)
+        .def("reset", &OnlineChebyshevFitter::reset)
+        .def("get_Nsamples", &OnlineChebyshevFitter::get_Nsamples)
+        .def("get_expansion", &OnlineChebyshevFitter::get_expansion)
+        ;
+
+    py::class_<CollectionCursor>(m, "CollectionCursor")
+        .def(py::init<const ChebyshevCollection &>(), py::keep_alive<1, 2>())
+        .def("locate", &CollectionCursor::locate)
+        .def("__call__", [](CollectionCursor& c, const double x) { return c(x); }, py::is_operator())
+        .def("__call__", [](CollectionCursor& c, const Eigen::Ref<const Eigen::ArrayXd>& x) { return c(x); }, py::is_operator())
+        .def("get_index", &CollectionCursor::get_index)
+        .def("reset", &CollectionCursor::reset)
+        ;
+
+    py::class_<HermiteTable>(m, "HermiteTable")
+        .def_static("factory", &HermiteTable::factory, py::arg("cc"), py::arg("degree"), py::arg("tol"), py::arg("max_cells") = std::size_t(1) << 24)
+        .def("__call__", [](const HermiteTable& t, const double x) { return t(x); }, py::is_operator())
+        .def("__call__", [](const HermiteTable& t, const Eigen::Ref<const Eigen::ArrayXd>& x) { return t(x); }, py::is_operator(), py::call_guard<py::gil_scoped_release>())
+        .def("xmin", &HermiteTable::xmin)
+        .def("xmax", &HermiteTable::xmax)
+        .def("get_degree", &HermiteTable::get_degree)
+        .def("get_Ncells", &HermiteTable::get_Ncells)
+        .def("get_verified_error", &HermiteTable::get_verified_error)
+        .def("get_memory_bytes", &HermiteTable::get_memory_bytes)
+        ;
+
+    py::class_<ChebyshevTensorTrain>(m, "ChebyshevTensorTrain")
+        .def(py::init<const std::vector<Eigen::MatrixXd> &, const std::vector<Eigen::Index> &, const Eigen::ArrayXd &, const Eigen::ArrayXd &>())
+        .def_static("factory", &ChebyshevTensorTrain::factory, py::arg("degrees"), py::arg("func"), py::arg("xmin"), py::arg("xmax"), py::arg("tol") = 1e-12, py::arg("max_rank") = 32)
+        .def("dim", &ChebyshevTensorTrain::dim)
+        .def("ranks", &ChebyshevTensorTrain::ranks)
+        .def("degrees", &ChebyshevTensorTrain::degrees)
+        .def("cores", &ChebyshevTensorTrain::cores)
+        .def("storage_size", &ChebyshevTensorTrain::storage_size)
+        .def("estimated_error", &ChebyshevTensorTrain::estimated_error)
+        .def("xmin", &ChebyshevTensorTrain::xmin)
+        .def("xmax", &ChebyshevTensorTrain::xmax)
+        .def("y", &ChebyshevTensorTrain::y)
+        .def("y_batch", &ChebyshevTensorTrain::y_batch, py::arg("X"), py::arg("Nthreads") = 1, py::call_guard<py::gil_scoped_release>())
+        .def("round", &ChebyshevTensorTrain::round)
+        ;
+
+    py::class_<BoundaryCondition>(m, "BoundaryCondition")
+        .def(py::init([](double x, const std::vector<double> &weights, double value) { return BoundaryCondition{x, weights, value}; }), py::arg("x"), py::arg("weights"), py::arg("value"))
+        .def_readwrite("x", &BoundaryCondition::x)
+        .def_readwrite("weights", &BoundaryCondition::weights)
+        .def_readwrite("value", &BoundaryCondition::value)
+        ;
+    m.def("generate_C_source", &generate_C_source, py::arg("cc"), py::arg("name"), py::arg("max_table_level") = 12);
+    m.def("solve_linear_BVP", &solve_linear_BVP, py::arg("a"), py::arg("f"), py::arg("bcs"), py::arg("N"));
+
     m.def("Clenshaw2DEigen", &Clenshaw2DEigen<Eigen::Ref<const Eigen::ArrayXXd>>);
     m.def("Clenshaw2DEigencomplex", &Clenshaw2DEigen<Eigen::Ref<const Eigen::ArrayXXcd>>);
 }
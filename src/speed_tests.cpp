@@ -1,6 +1,8 @@
 #include "ChebTools/ChebTools.h"
 #include <chrono>
 #include <map>
+#include <algorithm>
+#include <stdexcept>
 
 using namespace ChebTools;
 
@@ -18,14 +20,14 @@ double plus_by_inplace(ChebyshevExpansion &ce, const ChebyshevExpansion &ce2, in
     for (std::size_t i = 0; i < N; ++i) {
         ce += ce2;
     }
-    return ce.coef()(0);
+    return ce.coef_view()(0);
 }
 
 double mult_by_inplace(ChebyshevExpansion &ce, double val, int N) {
     for (std::size_t i = 0; i < N; ++i) {
         ce *= val;
     }
-    return ce.coef()(0);
+    return ce.coef_view()(0);
 }
 
 void mult_by(ChebyshevExpansion &ce, double val, int N) {
@@ -77,6 +79,32 @@ std::map<std::string, double> evaluation_speed_test(ChebyshevExpansion &cee, con
     endTime = std::chrono::system_clock::now();
     elap_us = std::chrono::duration<double>(endTime - startTime).count() / N*1e6;
     output["Clenshaw[1x1]"] = elap_us;
+
+    startTime = std::chrono::system_clock::now();
+    for (int i = 0; i < N; ++i) {
+        ypts = cee.y(xpts);
+    }
+    endTime = std::chrono::system_clock::now();
+    elap_us = std::chrono::duration<double>(endTime - startTime).count() / N*1e6;
+    output["y[vector]"] = elap_us;
+
+    startTime = std::chrono::system_clock::now();
+    for (int i = 0; i < N; ++i) {
+        ypts = cee.y_with_error(xpts).values;
+    }
+    endTime = std::chrono::system_clock::now();
+    elap_us = std::chrono::duration<double>(endTime - startTime).count() / N*1e6;
+    output["y_with_error[vector]"] = elap_us;
+
+    startTime = std::chrono::system_clock::now();
+    for (int i = 0; i < N; ++i) {
+        for (int n = static_cast<int>(xpts.size()) - 1; n >= 0; --n) {
+            ypts(n) = cee.y_with_error(xpts(n)).value;
+        }
+    }
+    endTime = std::chrono::system_clock::now();
+    elap_us = std::chrono::duration<double>(endTime - startTime).count() / N*1e6;
+    output["y_with_error[1x1]"] = elap_us;
     return output;
 }
 
@@ -95,4 +123,242 @@ Eigen::MatrixXd eigs_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrep
         results.row(i) << static_cast<double>(Nvec[i]), elap_us, maxeig;
     }
     return results;
-}
\ No newline at end of file
+}
+
+/// Time the real eigenvalues of colleague matrices from the generic eigenvalue solver and from the compact colleague matrix
+Eigen::MatrixXd real_roots_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrepeats) {
+    Eigen::MatrixXd results(Nvec.size(), 3);
+    for (std::size_t i = 0; i < Nvec.size(); ++i)
+    {
+        ChebyshevExpansion ce(Eigen::VectorXd::Random(Nvec[i] + 1));
+        Eigen::MatrixXd A = ce.companion_matrix(ce.coef());
+        double sum = 0;
+        auto startTime = std::chrono::system_clock::now();
+        for (std::size_t r = 0; r < Nrepeats; ++r) {
+            sum += eigenvalues(A, true).real().sum();
+        }
+        auto midTime = std::chrono::system_clock::now();
+        for (std::size_t r = 0; r < Nrepeats; ++r) {
+            sum += ColleagueMatrix(ce.coef()).balance().real_eigenvalues().sum();
+        }
+        auto endTime = std::chrono::system_clock::now();
+        results.row(i) << static_cast<double>(Nvec[i]),
+            std::chrono::duration<double>(midTime - startTime).count()/Nrepeats*1e6,
+            std::chrono::duration<double>(endTime - midTime).count()/Nrepeats*1e6;
+    }
+    return results;
+}
+
+/**
+ * Time the first fit at a degree (cold: the nodes and the L matrix are built) against later fits (warm), and the
+ * cost of warmup() together with the first fit after it; degrees N and N+1 must not be cached yet
+ */
+std::map<std::string, double> warmup_latency_test(std::size_t N, std::size_t Nrepeats) {
+    auto degrees = cached_degrees();
+    if (std::find(degrees.begin(), degrees.end(), N) != degrees.end() || std::find(degrees.begin(), degrees.end(), N + 1) != degrees.end()) {
+        throw std::invalid_argument("Degrees N and N+1 are already cached; cold latency needs degrees not used before");
+    }
+    auto f = [](double x) { return std::exp(x)*std::sin(3*x); };
+    auto elapsed_us = [](std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, std::size_t n) {
+        return std::chrono::duration<double>(end - start).count()/n*1e6;
+    };
+    std::map<std::string, double> output;
+    double sum = 0;
+    auto startTime = std::chrono::system_clock::now();
+    sum += ChebyshevExpansion::factory(N, f, -1, 1).coef_view()(0);
+    auto endTime = std::chrono::system_clock::now();
+    output["cold[us]"] = elapsed_us(startTime, endTime, 1);
+
+    startTime = std::chrono::system_clock::now();
+    for (std::size_t i = 0; i < Nrepeats; ++i) {
+        sum += ChebyshevExpansion::factory(N, f, -1, 1).coef_view()(0);
+    }
+    endTime = std::chrono::system_clock::now();
+    output["warm[us]"] = elapsed_us(startTime, endTime, Nrepeats);
+
+    startTime = std::chrono::system_clock::now();
+    warmup({ N + 1 });
+    endTime = std::chrono::system_clock::now();
+    output["warmup[us]"] = elapsed_us(startTime, endTime, 1);
+
+    startTime = std::chrono::system_clock::now();
+    sum += ChebyshevExpansion::factory(N + 1, f, -1, 1).coef_view()(0);
+    endTime = std::chrono::system_clock::now();
+    output["first_after_warmup[us]"] = elapsed_us(startTime, endTime, 1);
+    output["checksum"] = sum;
+    return output;
+}
+
+/**
+ * Time the global minimum of an expansion of each degree from the roots of the whole derivative (the baseline) and from
+ * minimize(); the columns are N, the two times in us, and the difference of the minima found
+ */
+Eigen::MatrixXd minimize_speed_test(std::vector<std::size_t> &Nvec, std::size_t Nrepeats) {
+    Eigen::MatrixXd results(Nvec.size(), 4);
+    for (std::size_t i = 0; i < Nvec.size(); ++i)
+    {
+        const double omega = 0.25*static_cast<double>(Nvec[i]);
+        auto ce = ChebyshevExpansion::factory(Nvec[i], [omega](double x) { return std::cos(omega*x) + 0.2*x*x + 0.05*std::sin(3*x); }, -1, 1);
+        double ybase = 0, ymin = 0;
+        auto startTime = std::chrono::system_clock::now();
+        for (std::size_t r = 0; r < Nrepeats; ++r) {
+            ybase = std::min(ce.y(ce.xmin()), ce.y(ce.xmax()));
+            for (double x : ce.deriv(1).real_roots(true)) {
+                ybase = std::min(ybase, ce.y(x));
+            }
+        }
+        auto midTime = std::chrono::system_clock::now();
+        for (std::size_t r = 0; r < Nrepeats; ++r) {
+            ymin = ce.minimize().y;
+        }
+        auto endTime = std::chrono::system_clock::now();
+        results.row(i) << static_cast<double>(Nvec[i]),
+            std::chrono::duration<double>(midTime - startTime).count()/Nrepeats*1e6,
+            std::chrono::duration<double>(endTime - midTime).count()/Nrepeats*1e6,
+            ymin - ybase;
+    }
+    return results;
+}
+
+/**
+ * Compare the evaluation of a collection with Clenshaw's method to that of cubic and quintic Hermite tables built from it
+ * to the tolerance tol.  Latency is timed with each input depending on the previous output, and throughput with the
+ * array evaluation of Npoints random inputs; times are in ns per point.
+ */
+std::map<std::string, double> Hermite_table_speed_test(double tol, std::size_t Npoints) {
+    auto f = [](double x) { return std::exp(-x)*std::sin(3*x) + std::log1p(x*x); };
+    auto cc = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<std::vector<ChebyshevExpansion>>(16, f, 0, 5, 3, 1e-14, 10));
+    auto elapsed_ns = [](std::chrono::system_clock::time_point start, std::chrono::system_clock::time_point end, std::size_t n) {
+        return std::chrono::duration<double>(end - start).count()/n*1e9;
+    };
+    const Eigen::ArrayXd x = (Eigen::ArrayXd::Random(Npoints) + 1)*2.5;
+    std::map<std::string, double> output;
+    double sum = 0;
+    auto time_it = [&](const std::string &key, const auto &g) {
+        double y = 0;
+        auto startTime = std::chrono::system_clock::now();
+        for (Eigen::Index i = 0; i < x.size(); ++i) {
+            // The tiny dependence on the previous output serializes the calls
+            y = g(x(i) + 1e-300*y);
+        }
+        auto midTime = std::chrono::system_clock::now();
+        Eigen::ArrayXd ys = g(x);
+        auto endTime = std::chrono::system_clock::now();
+        sum += y + ys.sum();
+        output["latency[" + key + "][ns]"] = elapsed_ns(startTime, midTime, Npoints);
+        output["throughput[" + key + "][ns]"] = elapsed_ns(midTime, endTime, Npoints);
+    };
+    time_it("Clenshaw", cc);
+    output["Npieces[Clenshaw]"] = static_cast<double>(cc.get_exps().size());
+    for (int degree : { 3, 5 }) {
+        const std::string key = (degree == 3) ? "cubic" : "quintic";
+        auto startTime = std::chrono::system_clock::now();
+        auto table = HermiteTable::factory(cc, degree, tol);
+        auto endTime = std::chrono::system_clock::now();
+        output["build[" + key + "][ms]"] = std::chrono::duration<double>(endTime - startTime).count()*1e3;
+        output["Ncells[" + key + "]"] = static_cast<double>(table.get_Ncells());
+        output["error[" + key + "]"] = (table(x) - cc(x)).abs().maxCoeff();
+        time_it(key, table);
+    }
+    output["checksum"] = sum;
+    return output;
+}
+
+/**
+ * Time the evaluation of a collection of Npieces equal-width expansions for Npoints inputs, one at a time, located by
+ * bisection (ChebyshevCollection::operator()) and by a CollectionCursor; the inputs are either a slow monotonic sweep
+ * across the domain, as from an ODE integrator, or random.  Times are in ns per point.
+ */
+std::map<std::string, double> cursor_speed_test(std::size_t Npieces, std::size_t Npoints) {
+    ChebyshevCollection::Container exps;
+    for (std::size_t i = 0; i < Npieces; ++i) {
+        exps.push_back(ChebyshevExpansion::factory(8, [](double x) { return std::sin(x); }, static_cast<double>(i), static_cast<double>(i + 1)));
+    }
+    const ChebyshevCollection cc(exps);
+    const double xmax = static_cast<double>(Npieces);
+    std::map<std::string, Eigen::ArrayXd> streams = {
+        { "monotonic", Eigen::ArrayXd::LinSpaced(Npoints, 0, xmax) },
+        { "random", (Eigen::ArrayXd::Random(Npoints) + 1)*xmax/2 }
+    };
+    std::map<std::string, double> output;
+    double sum = 0;
+    for (auto &[name, x] : streams) {
+        auto startTime = std::chrono::system_clock::now();
+        for (Eigen::Index i = 0; i < x.size(); ++i) { sum += cc(x(i)); }
+        auto midTime = std::chrono::system_clock::now();
+        CollectionCursor cursor(cc);
+        for (Eigen::Index i = 0; i < x.size(); ++i) { sum += cursor(x(i)); }
+        auto endTime = std::chrono::system_clock::now();
+        output["bisection[" + name + "][ns]"] = std::chrono::duration<double>(midTime - startTime).count()/Npoints*1e9;
+        output["cursor[" + name + "][ns]"] = std::chrono::duration<double>(endTime - midTime).count()/Npoints*1e9;
+    }
+    output["checksum"] = sum;
+    return output;
+}
+
+/**
+ * Compare dyadic_splitting with adaptive_splitting (with merging) at degree N and tolerance tol for functions with
+ * localized features on [-1, 1].  The cost of evaluation is reported as the number of pieces times the degree, along
+ * with the largest error at 10001 points.
+ */
+std::map<std::string, double> splitting_cost_test(std::size_t N, double tol) {
+    using Container = std::vector<ChebyshevExpansion>;
+    std::map<std::string, std::function<double(double)>> funcs = {
+        { "sqrt", [](double x) { return std::sqrt(1.001 - x); } },
+        { "atan", [](double x) { return std::atan(200*(x - 0.37)); } },
+        { "Runge", [](double x) { return 1/(1 + 1e4*(x - 0.61)*(x - 0.61)); } },
+        { "critical", [](double x) { return std::cbrt((x - 0.8)*(x - 0.8) + 1e-6) + x; } },
+        { "tanh", [](double x) { return std::tanh(30*(x + 0.2)) + 0.1*std::sin(3*x); } }
+    };
+    const Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(10001, -1, 1);
+    std::map<std::string, double> output;
+    for (auto &[name, f] : funcs) {
+        std::map<std::string, Container> splits = {
+            { "dyadic", ChebyshevExpansion::dyadic_splitting<Container>(N, f, -1, 1, 3, tol, 30) },
+            { "adaptive", ChebyshevExpansion::adaptive_splitting<Container>(N, f, -1, 1, 3, tol, 30) }
+        };
+        for (auto &[method, exps] : splits) {
+            const ChebyshevCollection cc(exps);
+            double err = 0;
+            for (Eigen::Index i = 0; i < x.size(); ++i) { err = std::max(err, std::abs(cc(x(i)) - f(x(i)))); }
+            output["Npieces[" + method + "][" + name + "]"] = static_cast<double>(exps.size());
+            output["cost[" + method + "][" + name + "]"] = static_cast<double>(exps.size()*N);
+            output["error[" + method + "][" + name + "]"] = err;
+        }
+    }
+    return output;
+}
+
+/**
+ * Time the roots of f(x)-c of a random expansion of degree N for Nshifts values of c, from a new expansion for each
+ * shift, from scalar calls on one ColleaguePencil, and from the batch call, both for the roots in the domain and for
+ * all the real roots.  Times are per shift.
+ */
+std::map<std::string, double> pencil_speed_test(std::size_t N, std::size_t Nshifts) {
+    ChebyshevExpansion ce(Eigen::VectorXd::Random(N + 1));
+    const Eigen::VectorXd cvals = Eigen::VectorXd::LinSpaced(Nshifts, -1, 1);
+    const std::vector<double> cs(cvals.data(), cvals.data() + cvals.size());
+    std::map<std::string, double> output;
+    double sum = 0;
+    auto time_us = [&](const std::function<void()> &body) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        body();
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double>(endTime - startTime).count()/Nshifts*1e6;
+    };
+    for (bool only_in_domain : { true, false }) {
+        const std::string name = only_in_domain ? "in domain" : "all";
+        output["expansion[" + name + "][us]"] = time_us([&]() {
+            for (double c : cs) { sum += static_cast<double>((ce - c).real_roots(only_in_domain).size()); }
+        });
+        const ColleaguePencil pencil(ce);
+        output["pencil scalar[" + name + "][us]"] = time_us([&]() {
+            for (double c : cs) { sum += static_cast<double>(pencil.real_roots(c, only_in_domain).size()); }
+        });
+        output["pencil batch[" + name + "][us]"] = time_us([&]() {
+            for (auto &r : pencil.real_roots(cs, only_in_domain)) { sum += static_cast<double>(r.size()); }
+        });
+    }
+    output["checksum"] = sum;
+    return output;
+}
@@ -3,6 +3,14 @@
 
 #include "ChebTools/ChebTools.h"
 
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
 /*
 From numpy:
 ----------
@@ -763,3 +771,923 @@ TEST_CASE("corner cases with linear ChebyshevExpansion",""){
     CHECK(linCheb.coef().size()==3);
   }
 }
+
+TEST_CASE("Coefficient storage across the inline/heap boundary", "[storage]")
+{
+    auto Ninline = ChebTools::CoefficientStorage::inline_capacity;
+    for (auto N : { Ninline - 2, Ninline - 1, Ninline, Ninline + 3 }) {
+        auto f = [](double x) { return exp(x) * sin(x); };
+        auto ce = ChebTools::ChebyshevExpansion::factory(N, f, -1, 1);
+        CAPTURE(N);
+
+        // Copy and move
+        auto copy = ce;
+        auto moved = std::move(copy);
+        CHECK(moved.coef() == ce.coef());
+        CHECK(moved.y(0.3) == ce.y(0.3));
+
+        // Growth in place
+        auto ce2 = ce;
+        ce2.times_x_inplace();
+        CHECK(ce2.coef().size() == ce.coef().size() + 1);
+        CHECK(std::abs(ce2.y_Clenshaw(0.3) - 0.3 * ce.y_Clenshaw(0.3)) < 1e-14);
+        // The recurrence evaluation must follow the new size after in-place growth
+        CHECK(std::abs(ce2.y_recurrence(0.3) - ce2.y_Clenshaw(0.3)) < 1e-14);
+    }
+}
+
+TEST_CASE("Recurrence evaluation on a const expansion", "[recurrence]")
+{
+    const auto ce = ChebTools::ChebyshevExpansion::factory(30, [](double x) { return exp(x) * sin(3*x); }, -2, 3);
+    // Enough points to span several blocks, including a partial one
+    Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(3*ChebTools::ChebyshevExpansion::recurrence_block_size + 7, -2, 3);
+    Eigen::VectorXd xscaled = (2 * x.array() - (ce.xmax() + ce.xmin())) / (ce.xmax() - ce.xmin());
+    Eigen::VectorXd yrec = ce.y(x), yClenshaw = ce.y_Clenshaw_xscaled(xscaled);
+    double err = (yrec - yClenshaw).cwiseAbs().maxCoeff();
+    CAPTURE(err);
+    CHECK(err < 1e-12);
+    for (auto i = 0; i < x.size(); ++i) {
+        CHECK(std::abs(ce.y_recurrence(x[i]) - yClenshaw[i]) < 1e-12);
+    }
+}
+
+TEST_CASE("Cached extrema and range queries on a collection", "[extrema]")
+{
+    using namespace ChebTools;
+    using Container = std::vector<ChebyshevExpansion>;
+    double PI = EIGEN_PI;
+    auto cc = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<Container>(18, [](double x) { return cos(x); }, -1, 2.5*PI, 3, 1e-12, 8));
+
+    auto extrema = cc.get_extrema_points();
+    REQUIRE(extrema.size() == 3);
+    for (auto i = 0; i < 3; ++i) {
+        CHECK(extrema[i].x == Approx(i*PI).margin(1e-12));
+        CHECK(extrema[i].y == Approx(cos(i*PI)));
+    }
+    CHECK(cc.global_max().y == Approx(1));
+    CHECK(cc.global_min().x == Approx(PI));
+    CHECK(cc.global_min().y == Approx(-1));
+
+    auto ranges = cc.get_monotonic_ranges();
+    REQUIRE(ranges.size() == 4);
+    CHECK(ranges[0].increasing);
+    CHECK(!ranges[1].increasing);
+    CHECK(ranges[2].increasing);
+    CHECK(!ranges[3].increasing);
+    CHECK(ranges.back().xmax == 2.5*PI);
+
+    CHECK(cc.max_on(-0.5, 0.5) == Approx(1));
+    CHECK(cc.max_on(0.5, 2.0) == Approx(cos(0.5)));
+    CHECK(cc.min_on(0.5, 4.0) == Approx(-1));
+    CHECK(cc.min_on(4.0, 0.5) == Approx(-1));
+
+    SECTION("Concurrent first use publishes a single cache") {
+        auto fresh = ChebyshevCollection(cc.get_exps());
+        std::vector<std::shared_ptr<const ExtremaCache>> caches(8);
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < caches.size(); ++i) {
+            threads.emplace_back([&, i]() { caches[i] = fresh.get_extrema_cache(); });
+        }
+        for (auto& t : threads) { t.join(); }
+        for (auto& c : caches) { CHECK(c == caches.front()); }
+        // A cache that is held survives the collection dropping it
+        auto held = fresh.get_extrema_cache();
+        fresh.get_exps_mutable();
+        CHECK(held->extrema.size() == 3);
+        CHECK(fresh.get_extrema_cache() != held);
+    }
+    SECTION("Threaded build matches the serial one") {
+        auto threaded = ChebyshevCollection(cc.get_exps()).get_extrema_cache(3);
+        REQUIRE(threaded->extrema.size() == extrema.size());
+        for (std::size_t i = 0; i < extrema.size(); ++i) {
+            CHECK(threaded->extrema[i].x == extrema[i].x);
+        }
+    }
+}
+
+TEST_CASE("Vectorized Taylor extrapolation and extrapolating collection", "[extrapolation]")
+{
+    using namespace ChebTools;
+    auto f = [](double x) { return exp(x); };
+    auto ce = ChebyshevExpansion::factory(21, f, -1, 1);
+    auto tay = make_Taylor_extrapolator(ce, 0.8, 8);
+    // The single-pass derivatives agree with the ones from deriv(n)
+    for (auto n = 0; n <= 8; ++n) {
+        CHECK(tay.get_coef()[n] == Approx(ce.deriv(n).y(0.8)).epsilon(1e-10));
+    }
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(5, 1.0, 2.0), y = tay(x);
+    for (auto i = 0; i < x.size(); ++i) {
+        CHECK(y[i] == tay(x[i]));
+        CHECK(std::abs(y[i] - f(x[i])) < 1e-4);
+    }
+
+    using Container = std::vector<ChebyshevExpansion>;
+    auto cc = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<Container>(12, f, -1, 1, 3, 1e-12, 8));
+    CHECK_THROWS(cc(1.1));
+    CHECK(cc.get_Taylor_extrapolation() == -1);
+    cc.set_Taylor_extrapolation(6);
+    CHECK(cc.is_extrapolating());
+    CHECK(cc.get_Taylor_extrapolation() == 6);
+    Eigen::ArrayXd xx(4); xx << -1.05, 0.0, 0.9, 1.05;
+    Eigen::ArrayXd yy = cc(xx);
+    for (auto i = 0; i < xx.size(); ++i) {
+        CHECK(yy[i] == Approx(f(xx[i])).epsilon(1e-9));
+    }
+    cc.set_Taylor_extrapolation(-1);
+    CHECK_THROWS(cc(xx));
+}
+
+TEST_CASE("Restriction of an expansion in coefficient space", "[restrict]")
+{
+    auto f = [](double x) { return exp(x) * sin(3*x); };
+    auto ce = ChebTools::ChebyshevExpansion::factory(40, f, -2, 3);
+    for (auto [a, b] : { std::make_pair(-2.0, 3.0), std::make_pair(-1.3, 0.2), std::make_pair(2.5, 3.0) }) {
+        auto r = ce.restrict(a, b);
+        CHECK(r.xmin() == a);
+        CHECK(r.xmax() == b);
+        auto sampled = ChebTools::ChebyshevExpansion::factory(40, f, a, b);
+        double err = (r.coef() - sampled.coef()).cwiseAbs().maxCoeff();
+        CAPTURE(a);
+        CAPTURE(b);
+        CAPTURE(err);
+        CHECK(err < 1e-12);
+    }
+}
+
+TEST_CASE("Arithmetic on collections with different breakpoints", "[collection]")
+{
+    using namespace ChebTools;
+    using Container = std::vector<ChebyshevExpansion>;
+    auto f = [](double x) { return exp(x); };
+    auto g = [](double x) { return 2 + sin(5*x); };
+    auto cf = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<Container>(12, f, -1, 2, 3, 1e-13, 8));
+    auto cg = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<Container>(10, g, -1, 2, 3, 1e-13, 8));
+    REQUIRE(cf.get_breakpoints() != cg.get_breakpoints());
+
+    auto sum = cf + cg, diff = cf - cg, prod = cf * cg, quot = cf / cg;
+    CHECK(sum.get_exps().size() >= std::max(cf.get_exps().size(), cg.get_exps().size()));
+    for (double x : Eigen::ArrayXd::LinSpaced(31, -1, 2)) {
+        CAPTURE(x);
+        CHECK(sum(x) == Approx(f(x) + g(x)).epsilon(1e-12));
+        CHECK(diff(x) == Approx(f(x) - g(x)).epsilon(1e-12));
+        CHECK(prod(x) == Approx(f(x) * g(x)).epsilon(1e-12));
+        CHECK(quot(x) == Approx(f(x) / g(x)).epsilon(1e-10));
+    }
+    std::function<Eigen::ArrayXd(const Eigen::ArrayXd &)> square = [](const Eigen::ArrayXd& y) { return y.square(); };
+    CHECK(cf.apply(square)(0.3) == Approx(f(0.3) * f(0.3)).epsilon(1e-10));
+
+    auto cshort = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<Container>(10, g, -1, 1, 3, 1e-13, 8));
+    CHECK_THROWS(cf + cshort);
+
+    auto times = [](const ChebyshevExpansion& a, const ChebyshevExpansion& b) { return a*b; };
+    auto prod3 = cf.combine(cg, times, 3);
+    CHECK(prod3(0.7) == prod(0.7));
+    // An exception from the operation reaches the caller, whichever thread it is thrown on
+    auto thrower = [](const ChebyshevExpansion& a, const ChebyshevExpansion&) -> ChebyshevExpansion {
+        if (a.xmin() > 0) { throw std::invalid_argument("bad piece"); }
+        return a;
+    };
+    for (int Nthreads : { 1, 3 }) {
+        CHECK_THROWS_AS(cf.combine(cg, thrower, Nthreads), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Batched and high-degree restriction", "[restrict]")
+{
+    auto f = [](double x) { return exp(x) * sin(3*x); };
+    auto ce = ChebTools::ChebyshevExpansion::factory(40, f, -2, 3);
+    std::vector<double> breakpoints = { -2, -1.5, 0, 0.1, 3 };
+    SECTION("same degree") {
+        auto segments = ce.restrict_batch(breakpoints);
+        REQUIRE(segments.size() == 4);
+        for (auto i = 0; i < 4; ++i) {
+            auto single = ce.restrict(breakpoints[i], breakpoints[i + 1]);
+            CHECK(segments[i].xmin() == breakpoints[i]);
+            CHECK(segments[i].xmax() == breakpoints[i + 1]);
+            CHECK((segments[i].coef() - single.coef()).cwiseAbs().maxCoeff() < 1e-12);
+        }
+    }
+    SECTION("subdivide at a lower degree") {
+        auto segments = ce.subdivide(5, 30);
+        REQUIRE(segments.size() == 4);
+        for (auto& seg : segments) {
+            CHECK(seg.coef().size() == 31);
+            double x = (seg.xmin() + seg.xmax())/2;
+            CHECK(seg.y(x) == Approx(f(x)).epsilon(1e-10));
+        }
+    }
+    SECTION("FFT path above the threshold") {
+        auto N = ChebTools::ChebyshevExpansion::restrict_FFT_threshold + 10;
+        auto big = ChebTools::ChebyshevExpansion::factory(N, f, -2, 3);
+        auto r = big.restrict(-0.5, 1.0);
+        auto sampled = ChebTools::ChebyshevExpansion::factory(N, f, -0.5, 1.0);
+        CHECK((r.coef() - sampled.coef()).cwiseAbs().maxCoeff() < 1e-12);
+    }
+}
+
+TEST_CASE("Changing the degree of expansions", "[degree]")
+{
+    auto f = [](double x) { return exp(x) * sin(3*x); };
+    auto ce = ChebTools::ChebyshevExpansion::factory(30, f, -2, 3);
+    auto longer = ce.prolong(40);
+    CHECK(longer.coef().size() == 41);
+    CHECK(longer.coef().head(31) == ce.coef());
+    CHECK(longer.coef().tail(10).cwiseAbs().maxCoeff() == 0);
+    CHECK(longer.truncate_to(30).coef() == ce.coef());
+    CHECK_THROWS(ce.prolong(20));
+    CHECK_THROWS(ce.truncate_to(31));
+
+    SECTION("resampling nodal values") {
+        Eigen::VectorXd f30 = ce.get_node_function_values();
+        for (std::size_t Nnew : { 20, 30, 45 }) {
+            Eigen::VectorXd fnew = ChebTools::ChebyshevExpansion::resample_nodal_values(f30, Nnew);
+            auto expected = (Nnew > 30) ? ce.prolong(Nnew) : ce.truncate_to(Nnew);
+            CAPTURE(Nnew);
+            CHECK((fnew - expected.get_node_function_values()).cwiseAbs().maxCoeff() < 1e-12);
+        }
+    }
+}
+
+TEST_CASE("Cached nodal values do not outlive the coefficients", "[cache]")
+{
+    auto f = [](double x) { return exp(x); };
+    auto plain = ChebTools::ChebyshevExpansion::factory(10, f, 0, 1);
+    auto ce = plain;
+    ce.cache_nodal_function_values(plain.get_node_function_values());
+
+    auto same_values = [](const ChebTools::ChebyshevExpansion &a, const ChebTools::ChebyshevExpansion &b) {
+        Eigen::VectorXd fa = a.get_node_function_values(), fb = b.get_node_function_values();
+        return fa.size() == fb.size() && (fa - fb).cwiseAbs().maxCoeff() < 1e-13;
+    };
+    CHECK(same_values(ce + 2.0, plain + 2.0));
+    CHECK(same_values(ce - 2.0, plain - 2.0));
+    CHECK(same_values(ce.deriv(1), plain.deriv(1)));
+    CHECK(same_values(ce.prolong(15), plain.prolong(15)));
+    CHECK(std::abs((ce - 2.0).monotonic_solvex(0) - log(2.0)) < 1e-12);
+
+    // The derivative of a constant takes a shortcut, which must drop the cache too; a single coefficient has no
+    // Chebyshev-Lobatto nodes to compare at, so the check is that the cached value is not handed back
+    auto constant = ChebTools::ChebyshevExpansion(std::vector<double>{ 3.0 }, 0, 1);
+    constant.cache_nodal_function_values(Eigen::VectorXd::Constant(1, 3.0));
+    auto dconstant = constant.deriv(1);
+    CHECK(dconstant.coef()(0) == 0);
+    CHECK(dconstant.get_node_function_values()(0) != 3.0);
+}
+
+TEST_CASE("Online least-squares fitting", "[fitting]")
+{
+    using namespace ChebTools;
+    Eigen::VectorXd c(6); c << 1, -0.5, 0.25, 0.3, -0.1, 0.05;
+    auto exact = ChebyshevExpansion(c, 1, 4);
+    Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(200, 1, 4), y = exact.y(x);
+
+    SECTION("recovers a polynomial of the fitted degree") {
+        OnlineChebyshevFitter fitter(5, 1, 4);
+        CHECK_THROWS(fitter.get_expansion());
+        fitter.add_samples(x, y);
+        CHECK(fitter.get_Nsamples() == 200);
+        CHECK((fitter.get_expansion().coef() - c).cwiseAbs().maxCoeff() < 1e-12);
+    }
+    SECTION("agrees with a batch least-squares fit") {
+        OnlineChebyshevFitter fitter(3, 1, 4);
+        fitter.add_samples(x, y);
+        Eigen::MatrixXd A(x.size(), 4);
+        for (auto n = 0; n < 4; ++n) {
+            Eigen::VectorXd e = Eigen::VectorXd::Zero(n + 1); e(n) = 1;
+            A.col(n) = ChebyshevExpansion(e, 1, 4).y(x);
+        }
+        Eigen::VectorXd cbatch = A.colPivHouseholderQr().solve(y);
+        CHECK((fitter.get_expansion().coef() - cbatch).cwiseAbs().maxCoeff() < 1e-12);
+    }
+    SECTION("forgets old data") {
+        OnlineChebyshevFitter fitter(5, 1, 4, 0.8);
+        fitter.add_samples(x, y);
+        fitter.add_samples(x, (y.array() + 1).matrix());
+        auto fit = fitter.get_expansion();
+        CHECK(fit.y(2.5) == Approx(exact.y(2.5) + 1).epsilon(1e-10));
+    }
+}
+
+TEST_CASE("Ultraspherical spectral solution of boundary value problems", "[BVP]")
+{
+    using namespace ChebTools;
+    auto one = ChebyshevExpansion(Eigen::VectorXd::Ones(1), 0, 1);
+    SECTION("operators agree with deriv and multiplication") {
+        Eigen::VectorXd cu(8); cu << 0.3, -1, 0.5, 0.25, 0.1, -0.2, 0.05, 0.01;
+        Eigen::VectorXd ca(4); ca << 1, 0.5, -0.25, 0.125;
+        auto u = ChebyshevExpansion(cu), a = ChebyshevExpansion(ca);
+        const Eigen::Index n = 16;
+        Eigen::VectorXd uc = Eigen::VectorXd::Zero(n); uc.head(8) = cu;
+        Eigen::VectorXd du = Eigen::VectorXd::Zero(n); du.head(7) = u.deriv(1).coef();
+        CHECK((ultraspherical::differentiation(n, 1)*uc - ultraspherical::conversion(n, 0)*du).cwiseAbs().maxCoeff() < 1e-14);
+        Eigen::VectorXd au = Eigen::VectorXd::Zero(n); au.head(11) = (a*u).coef();
+        CHECK((ultraspherical::multiplication(a, n, 0)*uc - au).cwiseAbs().maxCoeff() < 1e-14);
+        // Multiplication commutes with conversion
+        ultraspherical::SparseMatrix S = ultraspherical::conversion(n, 1)*ultraspherical::conversion(n, 0);
+        CHECK((ultraspherical::multiplication(a, n, 2)*S*uc - S*au).cwiseAbs().maxCoeff() < 1e-13);
+    }
+    SECTION("constant coefficients") {
+        // u'' - u = 0, u(0) = 1, u(1) = e
+        auto u = solve_linear_BVP({-1.0*one, 0.0*one, one}, 0.0*one, {{0, {1}, 1}, {1, {1}, exp(1.0)}}, 20);
+        CHECK(u.y(0.5) == Approx(exp(0.5)).epsilon(1e-13));
+    }
+    SECTION("variable coefficients and a Robin condition") {
+        double xmin = -1, xmax = 2;
+        auto ex = [](double x) { return sin(2*x) + x*x*x; };
+        auto d1 = [](double x) { return 2*cos(2*x) + 3*x*x; };
+        auto d2 = [](double x) { return -4*sin(2*x) + 6*x; };
+        auto a0 = ChebyshevExpansion(std::vector<double>{2.0}, xmin, xmax);
+        auto a1 = ChebyshevExpansion::factory(1, [](double x) { return x; }, xmin, xmax);
+        auto a2 = ChebyshevExpansion::factory(2, [](double x) { return 1 + x*x; }, xmin, xmax);
+        auto f = ChebyshevExpansion::factory(40, [&](double x) { return (1 + x*x)*d2(x) + x*d1(x) + 2*ex(x); }, xmin, xmax);
+        auto u = solve_linear_BVP({a0, a1, a2}, f, {{xmin, {1}, ex(xmin)}, {xmax, {1, 1}, ex(xmax) + d1(xmax)}}, 40);
+        for (double x : {-0.7, 0.3, 0.9, 1.8}) {
+            CHECK(u.y(x) == Approx(ex(x)).epsilon(1e-12));
+        }
+        CHECK_THROWS(solve_linear_BVP({a0, a1, a2}, f, {{xmin, {1}, 0}}, 40));
+    }
+}
+
+TEST_CASE("Roots of shifted expansions from a colleague pencil", "[roots]")
+{
+    using namespace ChebTools;
+    auto f = ChebyshevExpansion::factory(30, [](double x) { return sin(3*x) + 0.3*x*x; }, -2, 3);
+    ColleaguePencil pencil(f);
+    for (double c : {-1.2, -0.4, 0.0, 0.35, 0.9, 3.0}) {
+        auto expected = (f - c).real_roots(true);
+        std::sort(expected.begin(), expected.end());
+        auto roots = pencil.real_roots(c);
+        REQUIRE(roots.size() == expected.size());
+        for (std::size_t i = 0; i < roots.size(); ++i) {
+            CHECK(roots[i] == Approx(expected[i]).margin(1e-12));
+        }
+        auto all_roots = pencil.real_roots(c, false);
+        auto Nin = std::count_if(all_roots.begin(), all_roots.end(), [](double x) { return x >= -2 && x <= 3; });
+        CHECK(static_cast<std::size_t>(Nin) == roots.size());
+    }
+    SECTION("batch of shifts matches the scalar calls") {
+        std::vector<double> cs;
+        for (int i = 0; i < 400; ++i) { cs.push_back(-1.5 + 4.0*i/399.0); }
+        for (bool only_in_domain : {true, false}) {
+            for (int Nthreads : {1, 3}) {
+                auto batch = pencil.real_roots(cs, only_in_domain, Nthreads);
+                REQUIRE(batch.size() == cs.size());
+                // Bit-for-bit equal, so the batch takes the same path as the scalar call (the bracketed Newton solve
+                // in the domain rather than the eigenvalues, which differ in the last bits)
+                for (std::size_t i = 0; i < cs.size(); ++i) {
+                    CHECK(batch[i] == pencil.real_roots(cs[i], only_in_domain));
+                }
+            }
+        }
+    }
+
+    auto coll = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<std::vector<ChebyshevExpansion>>(8, [](double x) { return cos(x); }, 0, 3*EIGEN_PI, 3, 1e-13, 8));
+    auto solns = coll.solve_for_x(std::vector<double>{0.5});
+    CHECK(solns[0].size() == 3);
+}
+
+TEST_CASE("Real eigenvalues of upper Hessenberg matrices", "[roots]")
+{
+    using namespace ChebTools;
+    SECTION("all eigenvalues of a triangular matrix are kept") {
+        Eigen::MatrixXd A(3, 3); A << 1, 5, 2, 0, 2, 7, 0, 0, 3;
+        Eigen::VectorXd eigs = eigenvalues_upperHessenberg(A, false);
+        std::sort(eigs.data(), eigs.data() + eigs.size());
+        REQUIRE(eigs.size() == 3);
+        CHECK(eigs(0) == Approx(1)); CHECK(eigs(2) == Approx(3));
+    }
+    SECTION("complex pairs are dropped") {
+        Eigen::MatrixXd A(3, 3); A << 0, -1, 4, 1, 0, 2, 0, 0, 0.5;
+        Eigen::VectorXd eigs = eigenvalues_upperHessenberg(A, true);
+        REQUIRE(eigs.size() == 1);
+        CHECK(eigs(0) == Approx(0.5));
+    }
+    SECTION("root at zero") {
+        auto f = ChebyshevExpansion::factory(10, [](double x) { return x*(x - 0.5)*(x + 0.7); }, -1, 1);
+        auto roots = f.real_roots(true);
+        std::sort(roots.begin(), roots.end());
+        REQUIRE(roots.size() == 3);
+        CHECK(std::abs(roots[1]) < 1e-14);
+    }
+}
+
+TEST_CASE("Balancing a colleague matrix in compact form", "[roots]")
+{
+    using namespace ChebTools;
+    auto f = ChebyshevExpansion::factory(60, [](double x) { return sin(10*x) + exp(-x*x); }, -1, 1);
+    Eigen::MatrixXd A = f.companion_matrix(f.coef());
+    const Eigen::Index N = A.rows();
+    Eigen::VectorXd lower(N - 2), upper(N - 1), lastrow = A.row(N - 1).transpose(), D;
+    for (Eigen::Index j = 0; j < N - 2; ++j) { lower(j) = A(j + 1, j); }
+    for (Eigen::Index j = 0; j < N - 1; ++j) { upper(j) = A(j, j + 1); }
+    balance_colleague(lower, upper, lastrow, D);
+    Eigen::MatrixXd Abal = D.cwiseInverse().asDiagonal()*A*D.asDiagonal();
+    CHECK((Abal.row(N - 1).transpose() - lastrow).cwiseAbs().maxCoeff() < 1e-14*lastrow.cwiseAbs().maxCoeff());
+    for (Eigen::Index j = 0; j < N - 1; ++j) { CHECK(Abal(j, j + 1) == Approx(upper(j))); }
+    // Balancing is a similarity, and it brings the row and column norms of every index within a factor of 4
+    for (Eigen::Index i = 0; i < N; ++i) {
+        double ratio = Abal.col(i).norm()/Abal.row(i).norm();
+        CHECK(ratio < 4); CHECK(ratio > 0.25);
+    }
+}
+
+TEST_CASE("Compact colleague matrix", "[roots]")
+{
+    using namespace ChebTools;
+    Eigen::VectorXd c(7); c << 0.5, -1, 0.25, 0.75, -0.3, 0.2, 0.4;
+    ColleagueMatrix A(c);
+    auto ce = ChebyshevExpansion(c);
+    Eigen::MatrixXd Adense = ce.companion_matrix(c);
+    CHECK(A.size() == 6);
+    CHECK(A.dense() == Adense);
+    CHECK(A.upper_Hessenberg() == Adense.transpose());
+    Eigen::VectorXd v = Eigen::VectorXd::LinSpaced(6, -1, 2);
+    CHECK((A*v - Adense*v).cwiseAbs().maxCoeff() < 1e-15);
+    // The eigenvalues are the roots, and they are unchanged by balancing
+    Eigen::VectorXd roots = A.real_eigenvalues();
+    REQUIRE(roots.size() > 0);
+    for (Eigen::Index i = 0; i < roots.size(); ++i) {
+        CHECK(std::abs(ce.y(roots(i))) < 1e-12);
+    }
+    A.balance();
+    CHECK((A.dense() - A.balancing().cwiseInverse().asDiagonal()*Adense*A.balancing().asDiagonal()).cwiseAbs().maxCoeff() < 1e-14);
+    CHECK(A.real_eigenvalues().size() == roots.size());
+    CHECK_THROWS(ColleagueMatrix(Eigen::VectorXd::Ones(2)));
+}
+
+TEST_CASE("Batch evaluation, rootfinding and inversion", "[batch]")
+{
+    using namespace ChebTools;
+    std::vector<ChebyshevExpansion> exps;
+    for (int k = 1; k <= 5; ++k) {
+        exps.push_back(ChebyshevExpansion::factory(12, [k](double x) { return cos(k*x); }, 0, 3));
+    }
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(7, 0, 3);
+    for (int Nthreads : {1, 3, 0}) {
+        Eigen::ArrayXXd y = evaluate_many(exps, x, Nthreads);
+        REQUIRE(y.rows() == 5); REQUIRE(y.cols() == 7);
+        CHECK(y(2, 4) == Approx(exps[2].y(x(4))));
+        auto roots = real_roots_many(exps, true, Nthreads);
+        REQUIRE(roots.size() == 5);
+        CHECK(roots[1].size() == exps[1].real_roots(true).size());
+    }
+    auto mono = ChebyshevExpansion::factory(20, [](double x) { return exp(x); }, 0, 2);
+    Eigen::ArrayXd ys(3); ys << 1.5, 5.0, 100.0;
+    Eigen::ArrayXd xs = monotonic_solvex_many(mono, ys, 2);
+    CHECK(xs(0) == Approx(log(1.5)));
+    CHECK(xs(1) == Approx(log(5.0)));
+    CHECK(std::isnan(xs(2)));
+}
+
+TEST_CASE("Generated C source for a collection", "[codegen]")
+{
+    using namespace ChebTools;
+    auto f = [](double x) { return sin(x) + 0.1*x*x; };
+    std::vector<std::pair<std::string, ChebyshevCollection>> cases = {
+        {"dyadic", ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<std::vector<ChebyshevExpansion>>(8, f, 0, 10, 3, 1e-12, 8))},
+        {"uniform", ChebyshevCollection(ChebyshevExpansion::factory(30, f, -1, 1).subdivide(5, 30))},
+        {"general", ChebyshevCollection({ChebyshevExpansion::factory(20, f, 0, 0.3), ChebyshevExpansion::factory(12, f, 0.3, 2.9), ChebyshevExpansion::factory(25, f, 2.9, 7)})},
+    };
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(41, 0, 1);
+    for (auto &[name, cc] : cases) {
+        auto src = generate_C_source(cc, "f_" + name);
+        CHECK(src.find("double f_" + name + "(double x)") != std::string::npos);
+        if (name == "dyadic") { CHECK(src.find("f_dyadic_table") != std::string::npos); }
+        if (name == "general") { CHECK(src.find("f_general_breaks") != std::string::npos); }
+
+        // Compile the generated code with a driver that prints values, if a compiler is at hand
+        const double xmin = cc.get_exps().front().xmin(), xmax = cc.get_exps().back().xmax();
+        std::string stem = "chebtools_codegen_" + name;
+        {
+            std::ofstream ofs(stem + ".c");
+            ofs << src << "\n#include <stdio.h>\n#include <stdlib.h>\nint main(int argc, char **argv) {\n"
+                << "    for (int i = 1; i < argc; ++i) { printf(\"%.17g\\n\", f_" << name << "(atof(argv[i]))); }\n    return 0;\n}\n";
+        }
+        std::ostringstream cmd;
+        cmd << "cc -O2 -o " << stem << " " << stem << ".c -lm > /dev/null 2>&1";
+        if (std::system(cmd.str().c_str()) != 0) {
+            WARN("No C compiler available to check the generated code");
+            std::remove((stem + ".c").c_str());
+            continue;
+        }
+        cmd.str(""); cmd << std::setprecision(17) << "./" << stem;
+        Eigen::ArrayXd xx = xmin + (xmax - xmin)*x;
+        for (auto xi : xx) { cmd << " " << xi; }
+        cmd << " " << xmax + 1 << " > " << stem << ".out";
+        REQUIRE(std::system(cmd.str().c_str()) == 0);
+        std::ifstream ifs(stem + ".out");
+        for (auto xi : xx) {
+            double y; ifs >> y;
+            CHECK(y == Approx(cc(xi)).epsilon(1e-14).margin(1e-14));
+        }
+        std::string outside; ifs >> outside;
+        CHECK(outside.find("nan") != std::string::npos);
+        ifs.close();
+        for (auto ext : {".c", ".out", ""}) { std::remove((stem + ext).c_str()); }
+    }
+}
+
+TEST_CASE("Compile-time Chebyshev-Lobatto tables", "[fixed]")
+{
+    using T16 = ChebTools::ChebyshevLobattoTables<16>;
+    static_assert(T16::nodes[0] == 1.0 && T16::nodes[16] == -1.0, "Ends of the nodes must be exact");
+    static_assert(T16::nodes[8] == 0.0, "Middle node must be exactly zero");
+    const Eigen::VectorXd &x = ChebTools::get_CLnodes(16);
+    const double exact_err = (x - T16::nodes_map()).cwiseAbs().maxCoeff();
+    CHECK(exact_err == 0);
+    Eigen::VectorXd xref = (Eigen::VectorXd::LinSpaced(17, 0, 16).array()*EIGEN_PI/16).cos();
+    CHECK((x - xref).cwiseAbs().maxCoeff() < 3e-16);
+
+    SECTION("Transforms of the tables are inverses") {
+        Eigen::Matrix<double, 17, 17> LU = T16::L_map()*T16::U_map();
+        CHECK((LU - Eigen::Matrix<double, 17, 17>::Identity()).cwiseAbs().maxCoeff() < 1e-14);
+    }
+    SECTION("Fixed-degree factory matches the runtime factory") {
+        auto f = [](double x) { return std::exp(x)*std::sin(3*x); };
+        auto ce = ChebTools::ChebyshevExpansion::factory(16, f, -0.5, 2);
+        auto cef = ChebTools::ChebyshevExpansion::factory_fixed<16>(f, -0.5, 2);
+        CHECK((ce.coef() - cef.coef()).cwiseAbs().maxCoeff() < 1e-15);
+        CHECK(cef.y(1.3) == Approx(f(1.3)).epsilon(1e-6));
+    }
+    SECTION("Largest fixed degree and the first runtime degree") {
+        using T64 = ChebTools::ChebyshevLobattoTables<ChebTools::max_fixed_degree>;
+        CHECK((ChebTools::get_CLnodes(64) - T64::nodes_map()).cwiseAbs().maxCoeff() == 0);
+        const Eigen::VectorXd &x65 = ChebTools::get_CLnodes(65);
+        CHECK(x65.size() == 66);
+        CHECK(x65(0) == 1.0);
+    }
+    SECTION("Runtime libraries are copied from the table of the same degree") {
+        auto f = [](double x) { return std::exp(x)*std::sin(3*x); };
+        auto check_degree = [&](auto tables) {
+            using T = decltype(tables);
+            const std::size_t N = T::Vector::RowsAtCompileTime - 1;
+            CAPTURE(N);
+            CHECK((ChebTools::get_CLnodes(N) - T::nodes_map()).cwiseAbs().maxCoeff() == 0);
+            auto ce = ChebTools::ChebyshevExpansion::factory(N, f, -0.5, 2);
+            auto cef = ChebTools::ChebyshevExpansion::factory_fixed<N>(f, -0.5, 2);
+            CHECK((ce.coef() - cef.coef()).cwiseAbs().maxCoeff() < 1e-15);
+        };
+        check_degree(ChebTools::ChebyshevLobattoTables<1>{});
+        check_degree(ChebTools::ChebyshevLobattoTables<2>{});
+        check_degree(ChebTools::ChebyshevLobattoTables<37>{});
+        check_degree(ChebTools::ChebyshevLobattoTables<63>{});
+    }
+}
+
+TEST_CASE("Warm-up and transform cache files", "[warmup]")
+{
+    using namespace ChebTools;
+    warmup({ 5, 90 });
+    auto degrees = cached_degrees();
+    CHECK(std::find(degrees.begin(), degrees.end(), 5) != degrees.end());
+    CHECK(std::find(degrees.begin(), degrees.end(), 90) != degrees.end());
+    CHECK_THROWS_AS(warmup({ 0 }), std::invalid_argument);
+    CHECK(std::is_sorted(degrees.begin(), degrees.end()));
+
+    // Degree 0 can be built on demand (a constant expansion), but is not written to the file
+    ChebyshevExpansion(std::vector<double>{ 1.0 }).get_node_function_values();
+    CHECK(cached_degrees().front() >= 1);
+
+    const std::string path = "chebtools_transform_cache.bin";
+    save_transform_cache(path);
+    CHECK(load_transform_cache(path) == degrees.size());
+    // Loading leaves the cached values (and the references to them) as they were
+    const Eigen::VectorXd *x90 = &get_CLnodes(90);
+    load_transform_cache(path);
+    CHECK(&get_CLnodes(90) == x90);
+    auto f = [](double x) { return std::cos(4*x); };
+    CHECK(ChebyshevExpansion::factory(90, f, 0, 1).y(0.3) == Approx(f(0.3)));
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        ofs << "not a cache";
+    }
+    CHECK_THROWS_AS(load_transform_cache(path), std::invalid_argument);
+    // A degree that the rest of the file cannot hold is rejected before the matrices are allocated
+    for (std::uint64_t N64 : { std::uint64_t(1) << 17, std::uint64_t(1) << 62, ~std::uint64_t(0) }) {
+        std::ofstream ofs(path, std::ios::binary);
+        const char magic[8] = { 'C','H','E','B','T','C','0','1' };
+        const std::uint64_t count = 1;
+        ofs.write(magic, sizeof(magic));
+        ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        ofs.write(reinterpret_cast<const char*>(&N64), sizeof(N64));
+        ofs << std::string(1 << 20, '\0');
+        ofs.close();
+        CAPTURE(N64);
+        CHECK_THROWS_AS(load_transform_cache(path), std::invalid_argument);
+    }
+    std::remove(path.c_str());
+    CHECK_THROWS_AS(load_transform_cache(path), std::invalid_argument);
+}
+
+TEST_CASE("Clenshaw evaluation with rounding error bounds", "[error]")
+{
+    using namespace ChebTools;
+    // Reference values in long double, where it carries more digits than double
+    auto reference = [](const Eigen::VectorXd &c, double xscaled) {
+        long double u_kp1 = c(c.size() - 1), u_kp2 = 0, X = xscaled;
+        for (Eigen::Index k = c.size() - 2; k >= 1; --k) {
+            long double u_k = 2*X*u_kp1 - u_kp2 + c(k);
+            u_kp2 = u_kp1; u_kp1 = u_k;
+        }
+        return c(0) + X*u_kp1 - u_kp2;
+    };
+    const bool has_reference = std::numeric_limits<long double>::digits > 60;
+
+    // Large alternating coefficients with a small sum: heavy cancellation near x = 1
+    Eigen::VectorXd c(31);
+    for (Eigen::Index k = 0; k < c.size(); ++k) { c(k) = ((k % 2) ? -1.0 : 1.0)*(1e3 + 0.37*k); }
+    ChebyshevExpansion ce(c, -2, 5);
+    Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(301, -2, 5);
+    auto vals = ce.y_with_error(x);
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+        auto r = ce.y_with_error(x(i));
+        CHECK(r.value == vals.values(i));
+        CHECK(r.error == Approx(vals.errors(i)).epsilon(1e-12));
+        CHECK(r.value == Approx(ce.y_Clenshaw(x(i))).epsilon(1e-10));
+        auto rs = ce.y_with_error_xscaled(ce.scale_x(x(i)));
+        CHECK(rs.error <= r.error);
+        // Not a loose bound: within a small multiple of eps times the sum of the magnitudes of the coefficients
+        CHECK(rs.error < 1e3*std::numeric_limits<double>::epsilon()*c.cwiseAbs().sum());
+        if (has_reference) {
+            CHECK(std::abs(rs.value - static_cast<double>(reference(c, ce.scale_x(x(i))))) <= rs.error);
+        }
+    }
+    SECTION("Extrapolation inflates the bound") {
+        auto inside = ce.y_with_error_xscaled(1.0), outside = ce.y_with_error_xscaled(1.2);
+        CHECK(outside.error > 10*inside.error);
+        if (has_reference) {
+            CHECK(std::abs(outside.value - static_cast<double>(reference(c, 1.2))) <= outside.error);
+        }
+    }
+    SECTION("Constant expansion is exact") {
+        ChebyshevExpansion c0(std::vector<double>{3.5}, 0, 1);
+        CHECK(c0.y_with_error(0.4).error == 0);
+        CHECK((c0.y_with_error(Eigen::VectorXd::LinSpaced(5, 0, 1)).errors == 0).all());
+    }
+}
+
+TEST_CASE("Range enclosures over sub-intervals", "[enclosure]")
+{
+    using namespace ChebTools;
+    auto f = [](double x) { return std::sin(6*x) + 0.3*x*x; };
+    auto ce = ChebyshevExpansion::factory(40, f, -1, 3);
+    auto sampled_range = [&](double a, double b) {
+        Eigen::VectorXd y = ce.y(Eigen::VectorXd::LinSpaced(2001, a, b));
+        return std::make_pair(y.minCoeff(), y.maxCoeff());
+    };
+    SECTION("Enclosures contain the range and tighten with bisection") {
+        auto exact = sampled_range(0.2, 1.7);
+        auto r0 = ce.range_enclosure(0.2, 1.7);
+        CHECK(r0.ymin <= exact.first);
+        CHECK(r0.ymax >= exact.second);
+        auto r = ce.range_enclosure(0.2, 1.7, 40);
+        CHECK(r.ymin <= exact.first);
+        CHECK(r.ymax >= exact.second);
+        CHECK(r.ymin >= r0.ymin);
+        CHECK(r.ymax <= r0.ymax);
+        CHECK(exact.first - r.ymin < 1e-2);
+        CHECK(r.ymax - exact.second < 1e-2);
+        CHECK_THROWS_AS(ce.range_enclosure(1, 1), std::invalid_argument);
+    }
+    SECTION("Batched enclosures match the single ones") {
+        std::vector<double> breaks = { -1, -0.2, 0.5, 1.1, 3 };
+        auto rs = ce.range_enclosure_batch(breaks);
+        auto rsb = ce.range_enclosure_batch(breaks, 10, 2);
+        REQUIRE(rs.size() == 4);
+        for (std::size_t i = 0; i < rs.size(); ++i) {
+            auto exact = sampled_range(breaks[i], breaks[i + 1]);
+            auto single = ce.range_enclosure(breaks[i], breaks[i + 1]);
+            CHECK(rs[i].ymin == Approx(single.ymin).margin(1e-10));
+            CHECK(rs[i].ymax == Approx(single.ymax).margin(1e-10));
+            CHECK(rsb[i].ymin <= exact.first);
+            CHECK(rsb[i].ymax >= exact.second);
+            CHECK(rsb[i].ymax - rsb[i].ymin <= rs[i].ymax - rs[i].ymin + 1e-12);
+        }
+    }
+    SECTION("Pruning of rootfinding") {
+        auto shifted = ce + 10.0;
+        CHECK(!shifted.might_take_value(0));
+        CHECK(shifted.real_roots(true).empty());
+        CHECK(ce.might_take_value(0.5));
+        std::vector<ChebyshevExpansion> pieces = ce.subdivide(8, 20);
+        ChebyshevCollection cc(pieces);
+        std::vector<double> ys = { -0.5, 0.0, 100 };
+        auto solns = cc.solve_for_x(ys);
+        for (std::size_t i = 0; i < ys.size(); ++i) {
+            auto single = cc.solve_for_x(ys[i]);
+            CHECK(solns[i].size() == single.size());
+            for (double x : solns[i]) { CHECK(f(x) == Approx(ys[i]).margin(1e-8)); }
+        }
+        CHECK(solns[2].empty());
+    }
+}
+
+TEST_CASE("Global minimum and maximum of an expansion", "[optimize]")
+{
+    using namespace ChebTools;
+    // The derivative-roots baseline: the extremes of the values at the ends and at the roots of the derivative
+    auto baseline = [](const ChebyshevExpansion &ce) {
+        Extremum lo{ ce.xmin(), ce.y(ce.xmin()) }, hi = lo;
+        std::vector<double> xs = ce.deriv(1).real_roots(true);
+        xs.push_back(ce.xmax());
+        for (double x : xs) {
+            const double y = ce.y(x);
+            if (y < lo.y) { lo = { x, y }; }
+            if (y > hi.y) { hi = { x, y }; }
+        }
+        return std::make_pair(lo, hi);
+    };
+    for (std::size_t N : { 3, 12, 60, 200 }) {
+        CAPTURE(N);
+        const double omega = 0.25*static_cast<double>(N);
+        auto ce = ChebyshevExpansion::factory(N, [omega](double x) { return std::cos(omega*x) + 0.2*x*x + 0.05*std::sin(3*x); }, -2, 1);
+        auto ref = baseline(ce);
+        auto mn = ce.minimize(), mx = ce.maximize();
+        CHECK(mn.y == Approx(ref.first.y).margin(1e-12));
+        CHECK(mx.y == Approx(ref.second.y).margin(1e-12));
+        CHECK(mn.x == Approx(ref.first.x).margin(1e-6));
+        CHECK(mx.x == Approx(ref.second.x).margin(1e-6));
+        CHECK(ce.argmin() == mn.x);
+        CHECK(ce.argmax() == mx.x);
+    }
+    SECTION("Sub-intervals and the ends") {
+        auto ce = ChebyshevExpansion::factory(30, [](double x) { return std::exp(x)*std::sin(4*x); }, 0, 3);
+        // Increasing on [0, 0.3], so the extremes are at the ends
+        auto mn = ce.minimize(0, 0.3), mx = ce.maximize(0, 0.3);
+        CHECK(mn.x == 0);
+        CHECK(mx.x == 0.3);
+        CHECK(ce.minimize(1, 1).y == ce.y(1));
+        CHECK_THROWS_AS(ce.minimize(2, 1), std::invalid_argument);
+        Eigen::VectorXd y = ce.y(Eigen::VectorXd::LinSpaced(30001, 0, 3));
+        CHECK(ce.minimize().y <= y.minCoeff());
+        CHECK(ce.minimize().y == Approx(y.minCoeff()).margin(1e-6));
+    }
+}
+
+TEST_CASE("Tensor-train Chebyshev approximation of functions of several variables", "[TT]")
+{
+    using namespace ChebTools;
+    for (std::size_t d : { 3, 4 }) {
+        CAPTURE(d);
+        Eigen::ArrayXd xmin = Eigen::ArrayXd::LinSpaced(d, -1, 0), xmax = xmin + 2;
+        auto f = [d](const Eigen::Ref<const Eigen::VectorXd> &x) { return 1.0/(3.0 + x.sum()/static_cast<double>(d)) + std::exp(-x.squaredNorm()/4); };
+        auto tt = ChebyshevTensorTrain::factory(std::vector<std::size_t>(d, 20), f, xmin, xmax);
+        CHECK(tt.dim() == d);
+        CHECK(tt.degrees() == std::vector<std::size_t>(d, 20));
+        CHECK(tt.ranks().front() == 1);
+        CHECK(tt.ranks().back() == 1);
+        CHECK(tt.estimated_error() < 1e-11);
+        // Far less storage than the full tensor of coefficients
+        CHECK(static_cast<double>(tt.storage_size()) < 0.2*std::pow(21.0, static_cast<double>(d)));
+
+        Eigen::ArrayXXd X = (Eigen::ArrayXXd::Random(500, d) + 1)/2;
+        for (std::size_t k = 0; k < d; ++k) { X.col(k) = xmin(k) + (xmax(k) - xmin(k))*X.col(k); }
+        Eigen::ArrayXd yb = tt.y_batch(X, 2);
+        double maxerr = 0, maxdiff = 0;
+        for (Eigen::Index i = 0; i < X.rows(); ++i) {
+            const Eigen::VectorXd x = X.row(i).transpose();
+            maxerr = std::max(maxerr, std::abs(tt.y(x) - f(x)));
+            maxdiff = std::max(maxdiff, std::abs(tt.y(x) - yb(i)));
+        }
+        CHECK(maxerr < 1e-11);
+        CHECK(maxdiff < 1e-13);
+
+        // Rounding to a loose tolerance lowers the ranks
+        auto tt2 = tt;
+        tt2.round(1e-4);
+        CHECK(tt2.storage_size() < tt.storage_size());
+        CHECK(std::abs(tt2.y(X.row(0).transpose()) - f(X.row(0).transpose())) < 1e-3);
+    }
+    SECTION("Bad input") {
+        Eigen::ArrayXd lo = Eigen::ArrayXd::Zero(2), hi = Eigen::ArrayXd::Ones(2);
+        auto f = [](const Eigen::Ref<const Eigen::VectorXd> &x) { return x.sum(); };
+        CHECK_THROWS_AS(ChebyshevTensorTrain::factory({ 3 }, f, lo, hi), std::invalid_argument);
+        CHECK_THROWS_AS(ChebyshevTensorTrain::factory({ 3, 0 }, f, lo, hi), std::invalid_argument);
+        std::vector<Eigen::MatrixXd> cores = { Eigen::MatrixXd::Ones(2, 3), Eigen::MatrixXd::Ones(2, 3) };
+        CHECK_NOTHROW(ChebyshevTensorTrain(cores, { 1, 2, 1 }, lo, hi));
+        CHECK_THROWS_AS(ChebyshevTensorTrain(cores, { 1, 3, 1 }, lo, hi), std::invalid_argument);
+        CHECK_THROWS_AS(ChebyshevTensorTrain(cores, { 1, 2 }, lo, hi), std::invalid_argument);
+        CHECK_THROWS_AS(ChebyshevTensorTrain(cores, { 1, 2, 1 }, lo, Eigen::ArrayXd::Ones(3)), std::invalid_argument);
+        // x0 + x1 in the tensor-train form: [T0, 1] x [1; T0]*... evaluated at a point
+        auto sum = ChebyshevTensorTrain::factory({ 1, 1 }, f, lo, hi);
+        CHECK(sum.y(Eigen::Vector2d(0.25, 0.5)) == Approx(0.75));
+    }
+}
+
+TEST_CASE("Hermite lookup tables made from a collection", "[Hermite]")
+{
+    using namespace ChebTools;
+    auto f = [](double x) { return std::exp(-x)*std::sin(3*x) + std::log1p(x*x); };
+    auto cc = ChebyshevCollection(ChebyshevExpansion::dyadic_splitting<std::vector<ChebyshevExpansion>>(16, f, 0, 5, 3, 1e-14, 10));
+    Eigen::ArrayXd x = (Eigen::ArrayXd::Random(20000) + 1)*2.5;
+    for (int degree : { 3, 5 }) {
+        for (double tol : { 1e-6, 1e-11 }) {
+            CAPTURE(degree); CAPTURE(tol);
+            auto table = HermiteTable::factory(cc, degree, tol);
+            CHECK(table.get_degree() == degree);
+            CHECK(table.get_verified_error() <= tol);
+            CHECK((table(x) - cc(x)).abs().maxCoeff() < 2*tol);
+            // Exact at the grid points and at the ends
+            CHECK(table(0.0) == Approx(cc(0.0)).margin(1e-14));
+            CHECK(table(5.0) == Approx(cc(5.0)).margin(1e-14));
+            CHECK(table(5.0/static_cast<double>(table.get_Ncells())) == Approx(cc(5.0/static_cast<double>(table.get_Ncells()))).margin(1e-14));
+            CHECK(table.get_memory_bytes() == table.get_Ncells()*(degree + 1)*sizeof(double));
+            CHECK_THROWS_AS(table(5.1), std::invalid_argument);
+        }
+    }
+    SECTION("Quintic tables reproduce quintic polynomials") {
+        auto p = ChebyshevCollection({ ChebyshevExpansion::factory(5, [](double x) { return 1 - 2*x + x*x*x - 0.5*std::pow(x, 5); }, -1, 2) });
+        auto table = HermiteTable::factory(p, 5, 1e-13);
+        CHECK(table.get_Ncells() == 64);
+    }
+    SECTION("Bad input") {
+        CHECK_THROWS_AS(HermiteTable::factory(cc, 4, 1e-8), std::invalid_argument);
+        CHECK_THROWS_AS(HermiteTable::factory(cc, 3, 0), std::invalid_argument);
+        CHECK_THROWS_AS(HermiteTable::factory(cc, 3, 1e-12, 100), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Cursor evaluation of a collection", "[cursor]")
+{
+    using namespace ChebTools;
+    ChebyshevCollection::Container exps;
+    for (int i = 0; i < 37; ++i) {
+        exps.push_back(ChebyshevExpansion::factory(8, [](double x) { return std::sin(x); }, 0.5*i, 0.5*(i + 1)));
+    }
+    const ChebyshevCollection cc(exps);
+    SECTION("Galloping search agrees with bisection from every hint") {
+        Eigen::ArrayXd x = (Eigen::ArrayXd::Random(200) + 1)*0.25*37;
+        for (int hint = -1; hint <= 37; ++hint) {
+            for (Eigen::Index j = 0; j < x.size(); ++j) {
+                CAPTURE(hint); CAPTURE(x(j));
+                int i = cc.get_galloping_index(x(j), hint);
+                CHECK(x(j) >= exps[i].xmin());
+                CHECK(x(j) <= exps[i].xmax());
+            }
+        }
+    }
+    SECTION("Monotonic and random streams") {
+        for (Eigen::ArrayXd x : { Eigen::ArrayXd(Eigen::ArrayXd::LinSpaced(1000, 0, 18.5)), Eigen::ArrayXd(Eigen::ArrayXd::LinSpaced(1000, 18.5, 0)), Eigen::ArrayXd((Eigen::ArrayXd::Random(1000) + 1)*9.25) }) {
+            CollectionCursor cursor(cc);
+            CHECK(cursor.get_index() == -1);
+            Eigen::ArrayXd y = cursor(x);
+            CHECK((y - cc(x)).abs().maxCoeff() < 1e-14);
+            const auto &last = exps[cursor.get_index()];
+            CHECK(x(x.size() - 1) >= last.xmin());
+            CHECK(x(x.size() - 1) <= last.xmax());
+            cursor.reset();
+            CHECK(cursor.get_index() == -1);
+        }
+    }
+    SECTION("Inputs outside the domain leave the cursor in place") {
+        CollectionCursor cursor(cc);
+        cursor(3.1);
+        int i = cursor.get_index();
+        CHECK_THROWS(cursor(-1.0));
+        CHECK(cursor.get_index() == i);
+    }
+}
+
+TEST_CASE("Singularity estimates and adaptive splitting", "[splitting]")
+{
+    using namespace ChebTools;
+    using Container = std::vector<ChebyshevExpansion>;
+    SECTION("Poles are located from the decay of the coefficients") {
+        auto s = ChebyshevExpansion::factory(32, [](double x) { return 1/(x - 2.3); }, 0, 2).nearest_singularity();
+        CHECK(s.z.real() == Approx(2.3).epsilon(1e-8));
+        CHECK(s.z.imag() == Approx(0).margin(1e-8));
+        CHECK(s.rho == Approx(1.3 + std::sqrt(1.3*1.3 - 1)).epsilon(1e-6));
+        auto r = ChebyshevExpansion::factory(64, [](double x) { return 1/(1 + 1e4*(x - 0.61)*(x - 0.61)); }, -1, 0.5).nearest_singularity();
+        CHECK(r.z.real() == Approx(0.61).epsilon(1e-6));
+        CHECK(std::abs(r.z.imag()) == Approx(0.01).epsilon(1e-4));
+        CHECK(r.misfit < 1e-6);
+        // Nothing to fit once the coefficients are at the rounding level
+        auto c = ChebyshevExpansion::factory(8, [](double x) { return x*x; }, -1, 1).nearest_singularity();
+        CHECK(std::isnan(c.z.real()));
+    }
+    SECTION("Fewer pieces than dyadic splitting for the same accuracy") {
+        std::vector<std::function<double(double)>> funcs = {
+            [](double x) { return std::sqrt(1.001 - x); },
+            [](double x) { return std::atan(200*(x - 0.37)); },
+            [](double x) { return std::cbrt((x - 0.8)*(x - 0.8) + 1e-6) + x; }
+        };
+        Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(2001, -1, 1);
+        for (auto &f : funcs) {
+            auto dyadic = ChebyshevExpansion::dyadic_splitting<Container>(32, f, -1, 1, 3, 1e-12, 30);
+            auto unmerged = ChebyshevExpansion::adaptive_splitting<Container>(32, f, -1, 1, 3, 1e-12, 30, false);
+            auto adaptive = ChebyshevExpansion::adaptive_splitting<Container>(32, f, -1, 1, 3, 1e-12, 30);
+            CHECK(adaptive.size() < dyadic.size());
+            CHECK(adaptive.size() <= unmerged.size());
+            ChebyshevCollection cc(adaptive);
+            for (auto xi : x) {
+                CAPTURE(xi);
+                CHECK(cc(xi) == Approx(f(xi)).epsilon(1e-11).margin(1e-11));
+            }
+            CHECK(adaptive.front().xmin() == -1);
+            CHECK(adaptive.back().xmax() == 1);
+        }
+    }
+    SECTION("Smooth functions are not split") {
+        CHECK(ChebyshevExpansion::adaptive_splitting<Container>(16, [](double x) { return std::exp(x); }, -1, 1, 3, 1e-12).size() == 1);
+    }
+}